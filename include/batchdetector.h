@@ -0,0 +1,110 @@
+// Copyright (c) 2017 Elvis Dukaj
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#pragma once
+
+#include "markerdetector.h"
+#include <QFile>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+// On-disk layout of the results of a batch detection:
+//
+//   ResultFileHeader
+//   { ResultRecordHeader, count * ResultMarker }*
+//
+// One record per frame, in frame order, frames without markers included.
+struct ResultFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+};
+
+struct ResultRecordHeader {
+    uint32_t frame;
+    uint32_t count;     // number of ResultMarker following
+    int64_t timestamp;  // timestamp of the frame, microseconds
+};
+
+struct ResultMarker {
+    uint64_t id;
+    float corners[4][2];
+    float rotation[3];
+    float translation[3];
+    float confidence;
+    uint32_t reserved;
+};
+
+class ResultRecorder {
+public:
+    explicit ResultRecorder(const QString& fileName);
+
+    // Throws std::runtime_error when the record cannot be written whole
+    void record(uint32_t frame, int64_t timestamp, const MarkerResults& markers);
+    uint64_t frameCount() const noexcept { return m_frameCount; }
+
+    // Flushes and closes the file, after the last record. Writes are
+    // buffered: a full disk may only show here, as a std::runtime_error.
+    void finish();
+
+private:
+    QFile m_file;
+    std::vector<ResultMarker> m_markers;
+    uint64_t m_frameCount;
+};
+
+// Offline detection over many frames. Frames are split in chunks handed to a
+// pool of threads sharing one detector; each chunk is detected in order with
+// a fresh DetectorScratch, so tracking and change detection work within a
+// chunk while chunks stay independent. Results are delivered in frame order.
+class BatchDetector {
+public:
+    // Returns the grayscale of a frame, called from the worker threads
+    using FrameSource = std::function<cv::Mat(size_t index)>;
+    // Receives the results of every frame in order, from the calling thread
+    using ResultSink = std::function<void(size_t index, const MarkerResults& markers)>;
+
+    explicit BatchDetector(std::shared_ptr<const MarksDetector> detector);
+
+    // 0 uses one thread per core
+    int threads() const noexcept { return m_threads; }
+    void setThreads(int threads) noexcept { m_threads = threads; }
+
+    // Frames detected in a row with the same scratch, 1 makes every frame independent
+    size_t chunkSize() const noexcept { return m_chunkSize; }
+    void setChunkSize(size_t chunkSize) noexcept { m_chunkSize = chunkSize; }
+
+    const DetectionEffort& effort() const noexcept { return m_effort; }
+    void setEffort(const DetectionEffort& effort) noexcept { m_effort = effort; }
+
+    // Detects frames 0 to frameCount - 1. An exception thrown by a worker
+    // stops the batch and is rethrown once all the threads are joined.
+    void run(size_t frameCount, const FrameSource& frames, const ResultSink& sink) const;
+
+private:
+    std::shared_ptr<const MarksDetector> m_detector;
+    int m_threads;
+    size_t m_chunkSize;
+    DetectionEffort m_effort;
+};
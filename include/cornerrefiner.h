@@ -0,0 +1,84 @@
+// Copyright (c) 2017 Elvis Dukaj
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#pragma once
+
+#include "markerresults.h"
+#include <opencv2/core.hpp>
+#include <array>
+#include <vector>
+
+// Sub-pixel refinement of the corners of every marker of a frame in one
+// batch, with the algorithm of cv::cornerSubPix: each corner moves to the
+// point minimizing the dot products between the image gradient and the
+// vectors to the pixels of a small window around it. The window and the
+// iteration count follow the apparent size of the marker, and the corners
+// of a marker whose raw corners did not move since the previous frame keep
+// their previous refinement.
+class CornerRefiner {
+public:
+    static const int minHalfWindow = 2;
+    static const int maxHalfWindow = 8;
+
+    CornerRefiner();
+
+    // Refines the corners of markers from first on in place, with at most
+    // maxIterations iterations per corner. The markers before first are
+    // already refined and only remembered for the next frame.
+    void refine(const cv::Mat& grayscale, MarkerResults& markers, int maxIterations, int first = 0);
+
+    // Forgets the corners of the previous frame
+    void reset() noexcept;
+
+    // Corners refined by the last call, the others were reused
+    int refinedCorners() const noexcept { return m_refinedCorners; }
+
+private:
+    struct Corner {
+        int marker;
+        int index;
+        float x;
+        float y;
+        int halfWindow;
+        int iterations;
+    };
+
+    int previousIndex(uint64_t id) const noexcept;
+    bool moved(const MarkerResults& markers, int i, int previous) const noexcept;
+    void refineCorner(const cv::Mat& grayscale, Corner& corner);
+    void samplePatch(const cv::Mat& grayscale, float x, float y, int size);
+
+private:
+    // Gaussian weights of every window size, row major
+    std::array<std::vector<float>, maxHalfWindow + 1> m_masks;
+    std::vector<float> m_patch;
+    std::vector<Corner> m_corners;
+
+    // Raw and refined corners of the previous frame, by marker
+    int m_previousCount;
+    uint64_t m_previousIds[MarkerResults::capacity];
+    float m_previousRaw[MarkerResults::capacity][4][2];
+    float m_previousRefined[MarkerResults::capacity][4][2];
+
+    int m_refinedCorners;
+};
@@ -0,0 +1,60 @@
+// Copyright (c) 2017 Elvis Dukaj
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#pragma once
+
+#include "detectorstats.h"
+#include <opencv2/core.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Marker candidate search, the part of the detection that differs from one
+// detector to another. Back-ends binarize the search regions of the image
+// and find the quads that may be markers; ordering, filtering, decoding,
+// corner refinement and pose estimation are shared, see MarksDetector.
+class DetectorBackend {
+public:
+    virtual ~DetectorBackend() = default;
+
+    virtual const char* name() const noexcept = 0;
+
+    // Called with the 8 bit grayscale search image and its regions
+    virtual void binarize(const cv::Mat& image, const std::vector<cv::Rect>& regions) = 0;
+
+    // Appends to quads the candidates found in the binarized regions, whose
+    // sides are at least sqrt(minSquaredSideLength) long
+    virtual void findQuads(float minSquaredSideLength, std::vector<std::vector<cv::Point2f>>& quads,
+                           DetectorStats& stats) = 0;
+
+    // Binarized search image the candidates are decoded from. Back-ends
+    // without one return an empty Mat: each candidate is then decoded from
+    // the grayscale with its own threshold.
+    virtual cv::Mat binarized() const { return cv::Mat{}; }
+
+    // Names of the back-ends built in, the default one first
+    static std::vector<std::string> available();
+
+    // Throws std::runtime_error for unknown names
+    static std::unique_ptr<DetectorBackend> create(const std::string& name);
+};
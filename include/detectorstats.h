@@ -0,0 +1,137 @@
+// Copyright (c) 2017 Elvis Dukaj
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#pragma once
+
+#include "frametracer.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+// Log-linear histogram in the spirit of HdrHistogram: durations are counted
+// in microseconds with a relative precision of 1/subBuckets, from 1 us up
+// to more than an hour. Recording is a single relaxed atomic increment.
+class LatencyHistogram {
+public:
+    static const int subBucketBits = 4;
+    static const int subBuckets = 1 << subBucketBits;
+    static const int bucketCount = (32 - subBucketBits + 1) * subBuckets;
+
+    LatencyHistogram();
+
+    void record(std::chrono::microseconds value) noexcept;
+    void reset() noexcept;
+
+    uint64_t count() const noexcept;
+    std::chrono::microseconds max() const noexcept;
+
+    // Smallest recorded value that is greater or equal to the given
+    // fraction of the recorded values, e.g. 0.99 for the p99
+    std::chrono::microseconds percentile(double fraction) const noexcept;
+
+private:
+    std::array<std::atomic<uint64_t>, bucketCount> m_buckets;
+    std::atomic<uint64_t> m_max;
+};
+
+// Always-on instrumentation of MarksDetector. All the accessors are thread
+// safe: the detector records from its own thread while readers take
+// snapshots whenever they want.
+class DetectorStats {
+public:
+    enum class Stage {
+        Binarize,
+        Contours,
+        Candidates,
+        Recognize,
+        Refine,
+        Pose,
+        Frame,
+        Count
+    };
+
+    enum class Counter {
+        Frames,
+        UnchangedFrames,
+        Contours,
+        Quads,
+        RejectedNotQuad,
+        RejectedNotConvex,
+        RejectedTooSmall,
+        RejectedTooNear,
+        RejectedOutsideRegion,
+        RejectedOverCap,
+        RejectedBorder,
+        RejectedOrientation,
+        CrcFailures,
+        ValidMarkers,
+        Count
+    };
+
+    DetectorStats();
+
+    void record(Stage stage, std::chrono::microseconds duration) noexcept;
+    void add(Counter counter, uint64_t value = 1) noexcept;
+
+    const LatencyHistogram& histogram(Stage stage) const noexcept;
+    uint64_t counter(Counter counter) const noexcept;
+
+    void reset() noexcept;
+    void dump(std::ostream& os) const;
+
+    static const char* name(Stage stage) noexcept;
+    static const char* name(Counter counter) noexcept;
+
+private:
+    std::array<LatencyHistogram, static_cast<size_t>(Stage::Count)> m_histograms;
+    std::array<std::atomic<uint64_t>, static_cast<size_t>(Counter::Count)> m_counters;
+};
+
+// Records the lifetime of the scope in the histogram of a stage,
+// and in the frame trace when tracing is enabled
+class StageTimer {
+public:
+    StageTimer(DetectorStats& stats, DetectorStats::Stage stage) noexcept
+        : m_stats(stats)
+        , m_stage{stage}
+        , m_start{std::chrono::steady_clock::now()}
+    {
+    }
+
+    ~StageTimer()
+    {
+        auto end = std::chrono::steady_clock::now();
+        m_stats.record(m_stage, std::chrono::duration_cast<std::chrono::microseconds>(end - m_start));
+        FrameTracer::instance().complete(DetectorStats::name(m_stage), m_start, end);
+    }
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+private:
+    DetectorStats& m_stats;
+    DetectorStats::Stage m_stage;
+    std::chrono::steady_clock::time_point m_start;
+};
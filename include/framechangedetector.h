@@ -0,0 +1,65 @@
+// Copyright (c) 2017 Elvis Dukaj
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <vector>
+
+// Finds the parts of a frame that changed since the last frame considered
+// changed. Frames are reduced to a thumbnail of block averages, a block
+// changes when its average moved by more than the threshold. Changed blocks
+// are grouped into regions, enlarged by one block to catch the edges of
+// whatever moved.
+class FrameChangeDetector {
+public:
+    static const int blockSize = 16;
+
+    FrameChangeDetector();
+
+    // Mean luma difference of a block, 0..255, above which it changed
+    int threshold() const noexcept { return m_threshold; }
+    void setThreshold(int threshold) noexcept { m_threshold = threshold; }
+
+    // Returns false when no block of grayscale changed. The first frame, and
+    // any frame of another size, changed everywhere.
+    bool update(const cv::Mat& grayscale);
+
+    // Changed regions of the last update, full resolution coordinates
+    const std::vector<cv::Rect>& changedRegions() const noexcept { return m_changedRegions; }
+
+    // The next frame will be considered changed everywhere
+    void reset() noexcept;
+
+private:
+    int m_threshold;
+    bool m_hasReference;
+    cv::Mat m_thumbnail;
+    cv::Mat m_reference;
+    cv::Mat m_difference;
+    cv::Mat m_changedBlocks;
+    cv::Mat m_labels;
+    cv::Mat m_componentStats;
+    cv::Mat m_centroids;
+    std::vector<cv::Rect> m_changedRegions;
+};
@@ -0,0 +1,85 @@
+// Copyright (c) 2017 Elvis Dukaj
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#pragma once
+
+#include <QFile>
+#include <opencv2/core.hpp>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// On-disk layout of a raw luma capture:
+//
+//   FrameFileHeader
+//   { FrameRecordHeader, stride * height bytes of luma, padding to 16 bytes }*
+//
+// Opening a recorder overwrites the file. Records are written one after the
+// other and unbuffered, so a capture interrupted by a crash is still readable
+// up to the last complete frame.
+struct FrameFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+};
+
+struct FrameRecordHeader {
+    int64_t timestamp;  // microseconds since the recording was opened
+    int32_t width;
+    int32_t height;
+    int32_t stride;
+    uint32_t dataSize;  // payload size including the trailing padding
+};
+
+class FrameRecorder {
+public:
+    // Truncates fileName, a previous capture there is lost
+    explicit FrameRecorder(const QString& fileName);
+
+    // Throws std::runtime_error when the frame cannot be written whole
+    void record(const cv::Mat& grayscale);
+    uint64_t frameCount() const noexcept { return m_frameCount; }
+
+private:
+    QFile m_file;
+    std::chrono::steady_clock::time_point m_start;
+    std::vector<uchar> m_padding;
+    uint64_t m_frameCount;
+};
+
+class FrameReplay {
+public:
+    explicit FrameReplay(const QString& fileName);
+
+    size_t size() const noexcept { return m_frames.size(); }
+    int64_t timestamp(size_t index) const noexcept;
+
+    // Zero-copy view over the mapped file. The memory is mapped read only:
+    // the returned Mat must never be written to.
+    cv::Mat frame(size_t index) const;
+
+private:
+    QFile m_file;
+    const uchar* m_data;
+    std::vector<const FrameRecordHeader*> m_frames;
+};
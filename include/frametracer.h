@@ -0,0 +1,122 @@
+// Copyright (c) 2017 Elvis Dukaj
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+// Optional tracing of the frame path. While enabled, scoped events are
+// appended to a fixed size buffer owned by the recording thread, without any
+// lock; the capture is exported as Chrome trace-event JSON that can be opened
+// in chrome://tracing or Perfetto. Event names must be string literals.
+class FrameTracer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static FrameTracer& instance();
+
+    // Starting discards the previous capture
+    void start();
+    void stop() noexcept;
+    bool isEnabled() const noexcept { return m_enabled.load(std::memory_order_relaxed); }
+
+    void complete(const char* name, Clock::time_point begin, Clock::time_point end, int64_t arg = 0) noexcept;
+    void instant(const char* name, int64_t arg = 0) noexcept;
+
+    void exportJson(std::ostream& os) const;
+
+private:
+    struct Event {
+        const char* name;
+        char phase;
+        Clock::time_point begin;
+        Clock::time_point end;
+        int64_t arg;
+    };
+
+    struct ThreadBuffer {
+        static const size_t capacity = 1 << 16;
+
+        std::array<Event, capacity> events;
+        std::atomic<size_t> size;
+        std::atomic<uint64_t> generation;
+        std::atomic<uint64_t> dropped;
+        int threadId;
+    };
+
+    // Thread local owner of a buffer, returns it to the tracer when its thread exits
+    struct BufferLease;
+
+    FrameTracer();
+
+    ThreadBuffer* threadBuffer();
+    void releaseBuffer(ThreadBuffer* buffer) noexcept;
+    void append(const Event& event) noexcept;
+    Clock::time_point epoch() const noexcept;
+
+private:
+    std::atomic<bool> m_enabled;
+    std::atomic<uint64_t> m_generation;
+    // Clock::time_point of the start of the capture, read by exportJson from any thread
+    std::atomic<Clock::rep> m_epoch;
+
+    mutable std::mutex m_buffersMutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> m_buffers;
+    // Buffers of finished threads, handed to the next threads that trace
+    std::vector<ThreadBuffer*> m_freeBuffers;
+};
+
+// Traces the lifetime of the scope, costs a relaxed load when tracing is off
+class TraceScope {
+public:
+    explicit TraceScope(const char* name, int64_t arg = 0) noexcept
+        : m_name{name}
+        , m_arg{arg}
+        , m_enabled{FrameTracer::instance().isEnabled()}
+    {
+        if (m_enabled)
+            m_begin = FrameTracer::Clock::now();
+    }
+
+    ~TraceScope()
+    {
+        if (m_enabled)
+            FrameTracer::instance().complete(m_name, m_begin, FrameTracer::Clock::now(), m_arg);
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* m_name;
+    int64_t m_arg;
+    bool m_enabled;
+    FrameTracer::Clock::time_point m_begin;
+};
@@ -0,0 +1,62 @@
+// Copyright (c) 2017 Elvis Dukaj
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#pragma once
+
+#include "markerdetector.h"
+#include <chrono>
+
+// Watches the time spent detecting each frame and sheds work when it does not
+// fit the budget anymore: every degradation level lowers the DetectionEffort
+// a little more and eventually skips frames. Levels are recovered one by one
+// once the smoothed detection time is well below the budget again.
+class LatencyGovernor {
+public:
+    static const int maxLevel = 5;
+
+    LatencyGovernor();
+
+    // A zero budget disables the governor
+    void setBudget(std::chrono::microseconds budget) noexcept;
+    std::chrono::microseconds budget() const noexcept { return m_budget; }
+
+    // Accounts the detection time of a processed frame,
+    // returns true when the degradation level changed
+    bool update(std::chrono::microseconds elapsed) noexcept;
+
+    // Frame skipping lever, to be called once per incoming frame
+    bool shouldSkip() noexcept;
+
+    int level() const noexcept { return m_level; }
+    DetectionEffort effort() const noexcept;
+
+private:
+    bool setLevel(int level) noexcept;
+
+private:
+    std::chrono::microseconds m_budget;
+    double m_average;
+    int m_level;
+    int m_framesAtLevel;
+    int m_skipped;
+};
@@ -24,37 +24,152 @@
 #pragma once
 
 #include "marker.h"
+#include "markerlayout.h"
+#include "cornerrefiner.h"
+#include "detectorbackend.h"
+#include "detectorstats.h"
+#include "framechangedetector.h"
+#include <memory>
+#include <string>
 
+// Knobs trading detection quality for speed, see LatencyGovernor
+struct DetectionEffort {
+    // Binarization and contour search run on a grayscale downscaled 2^pyramidLevel times
+    int pyramidLevel = 0;
+    // Search only around the markers found in the previous frame
+    bool trackingOnly = false;
+    // Maximum iterations of the sub-pixel corner refinement, 0 disables it
+    int subPixIterations = 30;
+    // Maximum number of candidates handed to the recognition, largest first
+    int maxCandidates = 64;
+};
+
+// Per-stream state of the detection: the buffers reused from one frame to
+// the next, the markers of the last frame and what tracking and change
+// detection remember of the previous ones. Threads sharing a MarksDetector
+// each detect with their own scratch.
+class DetectorScratch {
+public:
+    DetectorScratch();
+
+    // Markers of the last detected frame
+    const MarkerResults& markers() const noexcept { return m_markers; }
+
+    const DetectionEffort& effort() const noexcept { return m_effort; }
+    void setEffort(const DetectionEffort& effort) noexcept { m_effort = effort; }
+
+    FrameChangeDetector& changeDetector() noexcept { return m_changeDetector; }
+
+    // Forgets the previous frames, the next one is searched as a whole
+    void reset() noexcept;
+
+private:
+    friend class MarksDetector;
+
+    cv::Mat m_grayscale;
+    cv::Mat m_searchImage;
+    std::vector<cv::Mat> m_pyramid;
+    std::vector<cv::Rect> m_regions;
+    std::vector<cv::Rect> m_plannedRegions;
+    // Regions of interest in pixels of the full resolution image, and their
+    // bounding boxes, for m_regionsOfInterest and frames of m_regionsOfInterestSize
+    std::vector<std::vector<cv::Point2f>> m_regionsOfInterest;
+    cv::Size m_regionsOfInterestSize;
+    std::vector<std::vector<cv::Point2f>> m_regionOfInterestPolygons;
+    std::vector<cv::Rect> m_regionOfInterestRects;
+    std::unique_ptr<DetectorBackend> m_backend;
+    std::vector<std::vector<cv::Point2f>> m_quads;
+    std::vector<std::vector<cv::Point2f>> m_possibleContours;
+
+    cv::Mat m_canonicalMarkerImage;
+    PackedBinaryImage m_packedMarkerImage;
+    MarkerResults m_markers;
+    CornerRefiner m_cornerRefiner;
+
+    cv::Mat m_rvec;
+    cv::Mat m_tvec;
+
+    DetectionEffort m_effort;
+    bool m_changeDetection;
+    FrameChangeDetector m_changeDetector;
+    std::vector<cv::Rect> m_changedRegions;
+    // Markers before this index were kept from the previous frame
+    int m_firstDetected;
+    int m_framesSinceFullSearch;
+};
+
+// Detector configuration: calibration, marker layout, back-end, regions of
+// interest. Detecting does not modify it, any number of threads may call
+// detect at once as long as each one has its own DetectorScratch. A copy
+// shares the calibration but gets a scratch of its own for processFame.
 class MarksDetector {
 public:
     MarksDetector();
+    MarksDetector(const MarksDetector& other);
+
+    // Detects the markers of an 8 bit grayscale frame, the results live in scratch
+    const MarkerResults& detect(const cv::Mat& grayscale, DetectorScratch& scratch) const;
 
+    // Single stream use, with a scratch owned by the detector
     void processFame(cv::Mat& grayscale);
     uint64_t encode() const;
 
-    const std::vector<Marker>& markers() const noexcept;
+    const MarkerResults& markers() const noexcept;
+
+    const DetectionEffort& effort() const noexcept { return m_scratch.effort(); }
+    void setEffort(const DetectionEffort& effort) noexcept { m_scratch.setEffort(effort); }
+
+    // Back-end searching the marker candidates, one of DetectorBackend::available()
+    const std::string& backend() const noexcept { return m_backend; }
+    void setBackend(const std::string& name);
+
+    // When enabled only the parts of a frame that changed since the previous
+    // one are searched, the markers elsewhere are kept as they were, and a
+    // frame without changes keeps all the markers of the previous one
+    bool changeDetection() const noexcept { return m_changeDetection; }
+    void setChangeDetection(bool enabled) noexcept { m_changeDetection = enabled; }
+    FrameChangeDetector& changeDetector() noexcept { return m_scratch.changeDetector(); }
+
+    // Polygons, in image coordinates normalized to 0..1, outside of which
+    // nothing is searched: each one is binarized with its own threshold and
+    // candidates must lie inside one of them. No region searches everywhere.
+    const std::vector<std::vector<cv::Point2f>>& regionsOfInterest() const noexcept { return m_regionsOfInterest; }
+    void setRegionsOfInterest(const std::vector<std::vector<cv::Point2f>>& regions);
+
+    const DetectorStats& stats() const noexcept { return *m_stats; }
+    // Several detectors may account into the same statistics
+    void setStats(const std::shared_ptr<DetectorStats>& stats);
 
 private:
-    void binarize(const cv::Mat &grayscale);
-    void findContours();
-    void findCandidates();
-    void recognizeCandidates();
-    void estimatePose();
+    void buildPyramid(const cv::Mat& grayscale, DetectorScratch& scratch) const;
+    void planRegions(DetectorScratch& scratch) const;
+    void updateRegionsOfInterest(cv::Size frameSize, DetectorScratch& scratch) const;
+    void addSearchRegion(const cv::Rect& rect, DetectorScratch& scratch) const;
+    void addRegion(const cv::Rect& region, DetectorScratch& scratch) const;
+    bool insideRegionsOfInterest(const std::vector<cv::Point2f>& points, const DetectorScratch& scratch) const;
+    void restrictRegionsToChanges(DetectorScratch& scratch) const;
+    void keepUnchangedMarkers(DetectorScratch& scratch) const;
+    void filterCandidates(DetectorScratch& scratch) const;
+    float minSquaredSideLength(const DetectionEffort& effort) const noexcept;
+    void recognizeCandidates(DetectorScratch& scratch) const;
+    void refineCorners(DetectorScratch& scratch) const;
+    void estimatePose(DetectorScratch& scratch) const;
 
     void applyImage(const cv::Mat& image);
 
 private:
-    int m_minCountournSize;
     uint64_t m_id;
-    cv::Mat m_grayscale;
-    cv::Mat m_binarized;
-    std::vector<std::vector<cv::Point>> m_contours;
-    std::vector<std::vector<cv::Point2f>> m_possibleContours;
+    std::vector<std::vector<cv::Point2f>> m_regionsOfInterest;
+    std::string m_backend;
+    bool m_changeDetection;
 
     const cv::Size m_markerSize;
     std::vector<cv::Point2f> m_markerCorners2d;
-    std::vector<Marker> m_markers;
 
     cv::Mat m_distortion;
     cv::Mat m_cameraMatrix;
+
+    std::shared_ptr<DetectorStats> m_stats;
+
+    DetectorScratch m_scratch;
 };
@@ -25,18 +25,136 @@
 
 #include "abstractopencvrunnablefilter.h"
 #include "markerdetector.h"
+#include "framerecording.h"
+#include "frametracer.h"
+#include "latencygovernor.h"
+#include "overlaycache.h"
+#include <QStringList>
+#include <QTimer>
+#include <QVariantList>
+#include <QVariantMap>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 class MarkerDetectorFilter : public QAbstractVideoFilter {
     Q_OBJECT
+    Q_PROPERTY(QString recordFile READ recordFile WRITE setRecordFile NOTIFY recordFileChanged)
+    Q_PROPERTY(int latencyBudget READ latencyBudget WRITE setLatencyBudget NOTIFY latencyBudgetChanged)
+    Q_PROPERTY(int degradationLevel READ degradationLevel NOTIFY degradationLevelChanged)
+    Q_PROPERTY(QString backend READ backend WRITE setBackend NOTIFY backendChanged)
+    Q_PROPERTY(QStringList availableBackends READ availableBackends CONSTANT)
+    Q_PROPERTY(bool changeDetection READ changeDetection WRITE setChangeDetection NOTIFY changeDetectionChanged)
+    Q_PROPERTY(QVariantList regions READ regions WRITE setRegions NOTIFY regionsChanged)
+    Q_PROPERTY(QString overlayDirectory READ overlayDirectory WRITE setOverlayDirectory NOTIFY overlayDirectoryChanged)
+    Q_PROPERTY(QVariantMap statistics READ statistics NOTIFY statisticsChanged)
+    Q_PROPERTY(int statisticsInterval READ statisticsInterval WRITE setStatisticsInterval NOTIFY statisticsIntervalChanged)
+    Q_PROPERTY(QString statisticsFile READ statisticsFile WRITE setStatisticsFile NOTIFY statisticsFileChanged)
+    Q_PROPERTY(bool tracing READ tracing WRITE setTracing NOTIFY tracingChanged)
 
 public:
+    explicit MarkerDetectorFilter(QObject* parent = nullptr);
+
     QVideoFilterRunnable* createFilterRunnable() override;
 
+    QString recordFile() const { return m_recordFile; }
+    void setRecordFile(const QString& recordFile);
+
+    // Detection time budget per frame in milliseconds, 0 disables the governor
+    int latencyBudget() const { return m_latencyBudget; }
+    void setLatencyBudget(int latencyBudget);
+
+    int degradationLevel() const { return m_degradationLevel; }
+
+    // Detector back-end searching the marker candidates, one of availableBackends
+    QString backend() const;
+    void setBackend(const QString& backend);
+    QStringList availableBackends() const;
+
+    // Search only the parts of the frames that changed, see MarksDetector::setChangeDetection
+    bool changeDetection() const { return m_changeDetection; }
+    void setChangeDetection(bool changeDetection);
+
+    // Regions of interest in coordinates normalized to the frame size, 0..1.
+    // Each one is either a rect or a list of at least three points
+    // (Qt.rect/Qt.point values or objects with x, y, width and height).
+    QVariantList regions() const { return m_regions; }
+    void setRegions(const QVariantList& regions);
+
+    // Directory holding the images drawn over the markers, named after the
+    // marker ids (<id>.png or <id>.jpg). Markers without image get their
+    // outline drawn instead, see OverlayCache.
+    QString overlayDirectory() const;
+    void setOverlayDirectory(const QString& overlayDirectory);
+
+    // Snapshot of the detector statistics, latencies are in milliseconds
+    QVariantMap statistics() const;
+    const DetectorStats& detectorStats() const noexcept { return *m_stats; }
+
+    // Period in milliseconds of statisticsChanged and of the dumps to statisticsFile, 0 when disabled
+    int statisticsInterval() const { return m_statisticsTimer.isActive() ? m_statisticsTimer.interval() : 0; }
+    void setStatisticsInterval(int statisticsInterval);
+
+    QString statisticsFile() const { return m_statisticsFile; }
+    void setStatisticsFile(const QString& statisticsFile);
+
+    // Frame tracing is process wide, see FrameTracer
+    bool tracing() const { return FrameTracer::instance().isEnabled(); }
+    void setTracing(bool tracing);
+
+    // Writes the current capture as Chrome trace-event JSON
+    Q_INVOKABLE bool saveTrace(const QString& fileName) const;
+
 signals:
     void markerFound(QString id);
+    void recordFileChanged();
+    void latencyBudgetChanged();
+    void degradationLevelChanged();
+    void backendChanged();
+    void changeDetectionChanged();
+    void regionsChanged();
+    void overlayDirectoryChanged();
+    void statisticsChanged();
+    void statisticsIntervalChanged();
+    void statisticsFileChanged();
+    void tracingChanged();
 
 private:
     friend class ThresholdFilterRunnable;
+    friend class MarkerDetectorFilterRunnable;
+
+    void setDegradationLevel(int degradationLevel);
+
+    // Detector shared by the runnables. Settings changes publish a modified
+    // copy, runnables pick it up on their next frame.
+    std::shared_ptr<const MarksDetector> detector();
+    void publishDetector();
+    void applySettings(MarksDetector& detector) const;
+
+    int overlayDirectoryVersion() const { return m_overlayDirectoryVersion; }
+    QString overlayDirectory(int& version) const;
+    void publishStatistics();
+
+    QString m_recordFile;
+    QString m_statisticsFile;
+    QTimer m_statisticsTimer;
+    std::shared_ptr<DetectorStats> m_stats;
+    std::atomic<int> m_latencyBudget;
+    std::atomic<int> m_degradationLevel;
+    std::atomic<int> m_backendIndex;
+    std::atomic<bool> m_changeDetection;
+
+    QVariantList m_regions;
+
+    // Guards the shared detector and the parsed regions
+    std::mutex m_detectorMutex;
+    std::shared_ptr<const MarksDetector> m_detector;
+    std::vector<std::vector<cv::Point2f>> m_regionPolygons;
+
+    mutable std::mutex m_overlayDirectoryMutex;
+    QString m_overlayDirectory;
+    std::atomic<int> m_overlayDirectoryVersion;
 };
 
 class MarkerDetectorFilterRunnable : public AbstractVideoFilterRunnable {
@@ -44,7 +162,23 @@ public:
     MarkerDetectorFilterRunnable(MarkerDetectorFilter* filter);
     QVideoFrame run(QVideoFrame* input, const QVideoSurfaceFormat &surfaceFormat, RunFlags flags) override;
 
+private:
+    QVideoFrame process(QVideoFrame* frame);
+    void detect(cv::Mat& grayscale);
+    void traceArrival(const QVideoFrame& frame);
+
 private:
     MarkerDetectorFilter* m_filter;
-    MarksDetector m_marksDetector;
+    DetectorScratch m_scratch;
+    std::unique_ptr<FrameRecorder> m_recorder;
+    LatencyGovernor m_governor;
+    OverlayCache m_overlays;
+    int m_overlayDirectoryVersion;
+    cv::Mat m_warpedOverlay;
+    cv::Mat m_warpedOverlayMask;
+
+    FrameTracer::Clock::time_point m_lastRunEnd;
+    bool m_lastRunTraced;
+    qint64 m_lastStartTime;
+    double m_frameInterval;
 };
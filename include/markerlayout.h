@@ -0,0 +1,357 @@
+// Copyright (c) 2017 Elvis Dukaj
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#pragma once
+
+#include "bitops.h"
+#include "packedbinaryimage.h"
+#include <boost/crc.hpp>
+#include <array>
+#include <cstdlib>
+#include <cstdint>
+#include <utility>
+
+enum class MarkerStatus {
+    Valid,
+    BadBorder,
+    BadOrientation,
+    BadCrc
+};
+
+// Geometry of a marker, known at compile time. From the outside in a marker
+// is a black border BorderWidth cells thick, the orientation ring (a ring of
+// black cells with three white cells in its top and bottom rows telling how
+// the marker is rotated or flipped) and the payload square. The payload holds
+// DataBits id bits followed by CrcBits bits of the CRC-16 of the id, row by
+// row; the remaining payload cells are ignored.
+template <int GridSize, int CellPixels, int DataBits, int CrcBits, int BorderWidth = 1>
+struct MarkerLayout {
+    static constexpr int gridSize = GridSize;
+    static constexpr int cellPixels = CellPixels;
+    static constexpr int borderWidth = BorderWidth;
+    static constexpr int dataBits = DataBits;
+    static constexpr int crcBits = CrcBits;
+
+    // Side of the canonical marker image, in pixels
+    static constexpr int imageSize = GridSize * CellPixels;
+    static constexpr int orientationSize = GridSize - 2 * BorderWidth;
+    static constexpr int payloadSize = orientationSize - 2;
+
+    // A cell is white when more than half of its pixels are
+    static constexpr int minWhitePixels = CellPixels * CellPixels / 2;
+
+    static_assert(BorderWidth > 0, "a marker needs a border");
+    static_assert(payloadSize > 0, "the grid is too small for the border and the orientation ring");
+    static_assert(GridSize <= 64, "a row of cells must fit a 64 bit word");
+    static_assert(CellPixels > 0 && CellPixels <= 64, "a cell must span at most two words of a packed row");
+    static_assert(DataBits > 0 && DataBits <= 64, "ids are 64 bit");
+    static_assert(CrcBits > 0 && CrcBits <= 16, "the checksum is a CRC-16");
+    static_assert(DataBits + CrcBits <= payloadSize * payloadSize, "the payload does not fit the grid");
+};
+
+// 12x12 cells of 20 pixels, 6 rows of 8 data bits and 2 rows of CRC bits
+using DefaultMarkerLayout = MarkerLayout<12, 20, 48, 16>;
+
+namespace markerlayout {
+
+constexpr uint64_t lowBits(int count) noexcept
+{
+    return count >= 64 ? ~uint64_t{0} : (uint64_t{1} << count) - 1;
+}
+
+// Words of a packed row covered by a column of cells. A cell never spans more
+// than two words, lastMask is zero when it lies within the first one.
+struct CellSpan {
+    int firstWord;
+    uint64_t firstMask;
+    int lastWord;
+    uint64_t lastMask;
+};
+
+template <class Layout>
+struct CellSpans {
+    CellSpan spans[Layout::gridSize];
+};
+
+template <class Layout>
+constexpr CellSpans<Layout> makeCellSpans() noexcept
+{
+    CellSpans<Layout> result{};
+
+    for (int j = 0; j < Layout::gridSize; ++j)
+    {
+        const int first = j * Layout::cellPixels;
+        const int last = first + Layout::cellPixels - 1;
+        auto& span = result.spans[j];
+
+        span.firstWord = first / 64;
+        span.lastWord = last / 64;
+
+        if (span.firstWord == span.lastWord)
+        {
+            span.firstMask = lowBits(Layout::cellPixels) << (first % 64);
+            span.lastMask = 0;
+        }
+        else
+        {
+            span.firstMask = ~uint64_t{0} << (first % 64);
+            span.lastMask = lowBits(last % 64 + 1);
+        }
+    }
+
+    return result;
+}
+
+// Grid coordinates of every payload bit for each of the four orientations,
+// see orientationIndex
+template <class Layout>
+struct PayloadCells {
+    static constexpr int bits = Layout::dataBits + Layout::crcBits;
+
+    uint8_t row[4][bits];
+    uint8_t col[4][bits];
+};
+
+template <class Layout>
+constexpr PayloadCells<Layout> makePayloadCells() noexcept
+{
+    PayloadCells<Layout> result{};
+    const int last = Layout::orientationSize - 1;
+
+    for (int k = 0; k < PayloadCells<Layout>::bits; ++k)
+    {
+        // Position in the orientation ring coordinates once the marker is
+        // brought back to its canonical orientation
+        const int i = k / Layout::payloadSize + 1;
+        const int j = k % Layout::payloadSize + 1;
+
+        // 7: flip around the vertical axis
+        // 13: rotate 90 counterclockwise, then flip around the vertical axis
+        // 11: flip around the horizontal axis
+        // 14: rotate 90 clockwise, then flip around the vertical axis
+        const int rows[4] = {i, last - j, last - i, j};
+        const int cols[4] = {last - j, last - i, j, i};
+
+        for (int r = 0; r < 4; ++r)
+        {
+            result.row[r][k] = static_cast<uint8_t>(rows[r] + Layout::borderWidth);
+            result.col[r][k] = static_cast<uint8_t>(cols[r] + Layout::borderWidth);
+        }
+    }
+
+    return result;
+}
+
+// Rotation codes are made of the white corners of the orientation ring:
+// bottom right 1, top left 2, top right 4, bottom left 8. The index counts the
+// quarter turns clockwise from the canonical marker, code 7, to the image.
+constexpr int orientationIndex(int rotation) noexcept
+{
+    return rotation == 7 ? 0 : rotation == 13 ? 1 : rotation == 11 ? 2 : rotation == 14 ? 3 : -1;
+}
+
+inline int whitePixels(const uint64_t* row, const CellSpan& span) noexcept
+{
+    return popcount(row[span.firstWord] & span.firstMask) + popcount(row[span.lastWord] & span.lastMask);
+}
+
+// Adds the white pixels of one packed row to the count of every cell column,
+// one unrolled masked popcount per column
+template <class Layout, size_t... J>
+inline void accumulateRow(const uint64_t* row, int (&counts)[Layout::gridSize], std::index_sequence<J...>) noexcept
+{
+    constexpr auto spans = makeCellSpans<Layout>();
+    int expand[] = {(counts[J] += whitePixels(row, spans.spans[J]), 0)...};
+    (void)expand;
+}
+
+// Also adds to contrast how far each cell is from being half white
+template <class Layout, size_t... J>
+inline uint64_t whiteCells(const int (&counts)[Layout::gridSize], int& contrast, std::index_sequence<J...>) noexcept
+{
+    constexpr int cellArea = Layout::cellPixels * Layout::cellPixels;
+
+    uint64_t cells = 0;
+    int expand[] = {(cells |= uint64_t{counts[J] > Layout::minWhitePixels} << J,
+                     contrast += std::abs(2 * counts[J] - cellArea), 0)...};
+    (void)expand;
+    return cells;
+}
+
+}
+
+// Decodes the canonical marker image of a given layout
+template <class Layout>
+class MarkerCodec {
+public:
+    // Occupancy of the grid, bit j of row i is set for a white cell (i, j)
+    using Cells = std::array<uint64_t, Layout::gridSize>;
+
+    // image is the binarized marker brought to its canonical, square form.
+    // confidence goes from 0, every cell half white, to 1, every cell
+    // uniformly black or white. A valid marker also gets its orientation,
+    // the number of quarter turns clockwise from the marker to the image:
+    // the top left corner of the marker is image corner orientation.
+    static MarkerStatus decode(const PackedBinaryImage& image, uint64_t& id, float& confidence, int& orientation)
+    {
+        CV_Assert(image.rows() == Layout::imageSize && image.cols() == Layout::imageSize);
+
+        // Every check works on the occupancy of the cells, the image is only
+        // sampled once
+        const auto cells = sampleCells(image, confidence);
+
+        if (!checkFrame(cells))
+            return MarkerStatus::BadBorder;
+
+        const int rotation = checkOrientationFrame(cells);
+
+        if (rotation == 0)
+            return MarkerStatus::BadOrientation;
+
+        const MarkerStatus status = decodePayload(cells, rotation, id);
+
+        if (status == MarkerStatus::Valid)
+            orientation = markerlayout::orientationIndex(rotation);
+
+        return status;
+    }
+
+    // Cells of the marker of an id in its canonical orientation, the inverse
+    // of decode. Ids are truncated to DataBits.
+    static Cells encode(uint64_t id) noexcept
+    {
+        constexpr auto payload = markerlayout::makePayloadCells<Layout>();
+        constexpr int first = Layout::borderWidth;
+        constexpr int last = Layout::borderWidth + Layout::orientationSize - 1;
+
+        Cells cells{};
+
+        // White top left, top right and bottom right corners of the ring
+        cells[first] |= uint64_t{1} << first | uint64_t{1} << last;
+        cells[last] |= uint64_t{1} << last;
+
+        const uint64_t data = id & markerlayout::lowBits(Layout::dataBits);
+        const uint64_t crcBits = checksum(data);
+
+        for (int k = 0; k < Layout::dataBits + Layout::crcBits; ++k)
+        {
+            const uint64_t bit = k < Layout::dataBits ? data >> k & 1 : crcBits >> (k - Layout::dataBits) & 1;
+            cells[payload.row[0][k]] |= bit << payload.col[0][k];
+        }
+
+        return cells;
+    }
+
+    static Cells sampleCells(const PackedBinaryImage& image, float& confidence) noexcept
+    {
+        constexpr float maxContrast = static_cast<float>(Layout::imageSize) * Layout::imageSize;
+        const auto columns = std::make_index_sequence<Layout::gridSize>{};
+
+        Cells cells;
+        int contrast = 0;
+
+        for (int i = 0; i < Layout::gridSize; ++i)
+        {
+            int counts[Layout::gridSize] = {};
+
+            for (int y = 0; y < Layout::cellPixels; ++y)
+                markerlayout::accumulateRow<Layout>(image.row(i * Layout::cellPixels + y), counts, columns);
+
+            cells[i] = markerlayout::whiteCells<Layout>(counts, contrast, columns);
+        }
+
+        confidence = static_cast<float>(contrast) / maxContrast;
+        return cells;
+    }
+
+    static bool checkFrame(const Cells& cells) noexcept
+    {
+        constexpr int last = Layout::gridSize - Layout::borderWidth;
+        constexpr uint64_t borderColumns = markerlayout::lowBits(Layout::borderWidth)
+                                         | markerlayout::lowBits(Layout::borderWidth) << last;
+
+        // check top and bottom
+        for (int i = 0; i < Layout::borderWidth; ++i)
+            if (cells[i] || cells[last + i])
+                return false;
+
+        // check left and right
+        for (int i = Layout::borderWidth; i < last; ++i)
+            if (cells[i] & borderColumns)
+                return false;
+
+        return true;
+    }
+
+    // Returns the rotation code, 0 if the orientation ring is not valid
+    static int checkOrientationFrame(const Cells& cells) noexcept
+    {
+        constexpr int first = Layout::borderWidth;
+        constexpr int last = Layout::borderWidth + Layout::orientationSize - 1;
+        constexpr uint64_t ring = markerlayout::lowBits(Layout::orientationSize) << first;
+
+        // check top and bottom
+        if (popcount(cells[first] & ring) + popcount(cells[last] & ring) != 3)
+            return 0;
+
+        const auto cell = [&](int i, int j) { return static_cast<int>((cells[i] >> j) & 1); };
+
+        const int rotation = cell(first, last) << 2 | cell(first, first) << 1
+                           | cell(last, last) | cell(last, first) << 3;
+
+        return markerlayout::orientationIndex(rotation) < 0 ? 0 : rotation;
+    }
+
+    static MarkerStatus decodePayload(const Cells& cells, int rotation, uint64_t& id) noexcept
+    {
+        constexpr auto payload = markerlayout::makePayloadCells<Layout>();
+        const int r = markerlayout::orientationIndex(rotation);
+
+        const auto bit = [&](int k) { return (cells[payload.row[r][k]] >> payload.col[r][k]) & 1; };
+
+        uint64_t data = 0;
+
+        for (int k = 0; k < Layout::dataBits; ++k)
+            data |= bit(k) << k;
+
+        uint64_t crcBits = 0;
+
+        for (int k = 0; k < Layout::crcBits; ++k)
+            crcBits |= bit(Layout::dataBits + k) << k;
+
+        if (crcBits != checksum(data))
+            return MarkerStatus::BadCrc;
+
+        id = data;
+        return MarkerStatus::Valid;
+    }
+
+    static uint64_t checksum(uint64_t data) noexcept
+    {
+        boost::crc_16_type crc;
+        crc.process_bytes(&data, sizeof(data));
+
+        // Layouts with fewer CRC bits keep the low bits of the checksum
+        return crc.checksum() & markerlayout::lowBits(Layout::crcBits);
+    }
+};
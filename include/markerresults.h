@@ -0,0 +1,75 @@
+// Copyright (c) 2017 Elvis Dukaj
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+// Markers found in a frame. Every attribute is a fixed size array indexed by
+// marker, so the results of a frame live in one preallocated block: reading
+// an attribute of all markers walks contiguous memory and copying the
+// results of a frame is a single memcpy.
+struct MarkerResults {
+    static const int capacity = 64;
+    // Edges of the cube drawn over a marker, as pairs of image points
+    static const int cubeLines = 8;
+
+    int count;
+    uint64_t ids[capacity];
+    // Anti-clockwise corners, full resolution image coordinates
+    float corners[capacity][4][2];
+    // Rodrigues rotation and translation of the marker in camera coordinates
+    float rotations[capacity][3];
+    float translations[capacity][3];
+    float cubes[capacity][cubeLines][2][2];
+    // How clearly the cells were sampled, see MarkerCodec::decode
+    float confidences[capacity];
+
+    int size() const noexcept { return count; }
+    bool empty() const noexcept { return count == 0; }
+    bool full() const noexcept { return count == capacity; }
+    void clear() noexcept { count = 0; }
+
+    // Appends a marker without pose, returns its index or -1 when full
+    int add(uint64_t id, const std::vector<cv::Point2f>& points, float confidence) noexcept;
+
+    // Copies every attribute of marker from over marker to
+    void move(int from, int to) noexcept;
+
+    cv::Point2f corner(int i, int c) const noexcept { return cv::Point2f{corners[i][c][0], corners[i][c][1]}; }
+    void setCorner(int i, int c, cv::Point2f p) noexcept { corners[i][c][0] = p.x; corners[i][c][1] = p.y; }
+
+    // 4x1 CV_32FC2 views of the corners of marker i, or of the first count
+    // markers in a row, usable wherever OpenCV expects a point set
+    cv::Mat cornersOf(int i) noexcept { return cv::Mat{4, 1, CV_32FC2, corners[i]}; }
+    cv::Mat cornersOf(int i) const noexcept { return cv::Mat{4, 1, CV_32FC2, const_cast<float*>(&corners[i][0][0])}; }
+    cv::Mat allCorners() noexcept { return cv::Mat{4 * count, 1, CV_32FC2, corners}; }
+
+    // 16x1 CV_32FC2 view of the cube end points of marker i
+    cv::Mat cubeOf(int i) noexcept { return cv::Mat{2 * cubeLines, 1, CV_32FC2, cubes[i]}; }
+};
+
+static_assert(std::is_trivially_copyable<MarkerResults>::value, "MarkerResults must be copyable with memcpy");
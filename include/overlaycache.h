@@ -0,0 +1,93 @@
+// Copyright (c) 2017 Elvis Dukaj
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#pragma once
+
+#include "markerresults.h"
+#include <QString>
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+
+// Overlay images drawn over the markers, one per marker id, loaded on first
+// use from <directory>/<id>.png (or .jpg) and converted to the layout of the
+// video frames. The least recently used overlays are evicted once more than
+// capacity are held, by default as many as markers in a frame so that a full
+// frame never evicts its own overlays. Ids without an image are remembered
+// apart, without taking room, so that a missing file costs one lookup on disk
+// only.
+class OverlayCache {
+public:
+    struct Overlay {
+        // Same type as the frames it was requested for, empty if none
+        cv::Mat image;
+        // Where the overlay is opaque, empty when it is opaque everywhere
+        cv::Mat mask;
+    };
+
+    explicit OverlayCache(size_t capacity = MarkerResults::capacity);
+
+    const QString& directory() const noexcept { return m_directory; }
+    void setDirectory(const QString& directory);
+
+    // Overlay of id for frames of the given type, CV_8UC4, CV_8UC3 or CV_8UC1
+    const Overlay& overlay(uint64_t id, int frameType);
+
+    size_t size() const noexcept { return m_entries.size(); }
+    void clear();
+
+private:
+    using Key = std::pair<uint64_t, int>;
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const noexcept
+        {
+            return std::hash<uint64_t>{}(key.first * 31 + static_cast<uint64_t>(key.second));
+        }
+    };
+
+    struct Entry {
+        Key key;
+        Overlay overlay;
+    };
+
+    Overlay load(uint64_t id, int frameType) const;
+
+private:
+    size_t m_capacity;
+    QString m_directory;
+    // Most recently used first
+    std::list<Entry> m_entries;
+    std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> m_index;
+    std::unordered_set<Key, KeyHash> m_missing;
+    // Returned for the ids of m_missing
+    Overlay m_none;
+};
+
+// Warps overlay onto the quad of marker i, touching only the bounding box of
+// the quad. warpedImage and warpedMask are scratch buffers reused from call
+// to call, they are only needed by overlays with transparent parts.
+void drawMarkerOverlay(cv::Mat& frame, const MarkerResults& markers, int i, const OverlayCache::Overlay& overlay,
+                       cv::Mat& warpedImage, cv::Mat& warpedMask);
@@ -0,0 +1,59 @@
+// Copyright (c) 2017 Elvis Dukaj
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <vector>
+
+// Binary image storing one bit per pixel: pixel x of a row is bit x % 64 of
+// word x / 64. Rows are padded to whole words, the padding bits are zero.
+// Counting the set pixels of a marker cell is a masked popcount over a word or
+// two per row, see MarkerCodec.
+class PackedBinaryImage {
+public:
+    PackedBinaryImage();
+
+    // Sets the pixels of an 8 bit single channel image that are greater than
+    // the threshold, like cv::threshold with THRESH_BINARY. A threshold of
+    // zero packs a binary image.
+    void threshold(const cv::Mat& grayscale, int thresholdValue);
+
+    int rows() const noexcept { return m_rows; }
+    int cols() const noexcept { return m_cols; }
+    cv::Size size() const noexcept { return cv::Size{m_cols, m_rows}; }
+    int wordsPerRow() const noexcept { return m_wordsPerRow; }
+
+    const uint64_t* row(int y) const noexcept { return m_words.data() + static_cast<size_t>(y) * m_wordsPerRow; }
+    bool at(int y, int x) const noexcept { return (row(y)[x >> 6] >> (x & 63)) & 1; }
+
+private:
+    int m_rows;
+    int m_cols;
+    int m_wordsPerRow;
+    std::vector<uint64_t> m_words;
+};
+
+// Threshold chosen by Otsu's method, the same cv::threshold uses for THRESH_OTSU
+int otsuThreshold(const cv::Mat& grayscale);
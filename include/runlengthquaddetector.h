@@ -0,0 +1,78 @@
+// Copyright (c) 2017 Elvis Dukaj
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#pragma once
+
+#include "packedbinaryimage.h"
+#include <opencv2/core.hpp>
+#include <vector>
+
+// Contour-free candidate search. Every row of a packed binary image is
+// run-length encoded, dark runs are labelled into 8-connected components by
+// merging them with the overlapping runs of the previous row, and bounding
+// box, area and extreme points are accumulated per component during the
+// scan. Quads are fitted only to the components passing the size and fill
+// tests, nothing is traced pixel by pixel.
+class RunLengthQuadDetector {
+public:
+    // Appends the quads found in image, offset is added to their corners
+    void detect(const PackedBinaryImage& image, cv::Point offset, float minSquaredSideLength,
+                std::vector<std::vector<cv::Point2f>>& quads);
+
+private:
+    struct Run {
+        int begin;
+        int end;
+        int label;
+    };
+
+    struct Extreme {
+        int value;
+        cv::Point point;
+    };
+
+    struct Component {
+        int parent;
+        int64_t area;
+        int minX, minY, maxX, maxY;
+
+        // Corners of an upright square are the extremes along x + y and
+        // x - y, those of a square rotated by 45 degrees along x and y
+        Extreme top, right, bottom, left;
+        Extreme minSum, maxSum, minDiff, maxDiff;
+
+        void add(const Run& run, int y) noexcept;
+        void merge(const Component& other) noexcept;
+    };
+
+    int newComponent();
+    int find(int label) noexcept;
+    int unite(int a, int b) noexcept;
+
+    bool fitQuad(const Component& component, float minSquaredSideLength, std::vector<cv::Point2f>& quad) const;
+
+private:
+    std::vector<Run> m_previousRuns;
+    std::vector<Run> m_currentRuns;
+    std::vector<Component> m_components;
+};
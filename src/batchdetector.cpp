@@ -0,0 +1,240 @@
+// Copyright (c) 2017 Elvis Dukaj
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "batchdetector.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+using namespace cv;
+using namespace std;
+
+namespace {
+
+const char resultFileMagic[8] = {'M', 'K', 'R', 'E', 'S', 'U', 'L', 'T'};
+const uint32_t resultFileVersion = 1;
+
+static_assert(sizeof(ResultRecordHeader) == 16, "ResultRecordHeader must not be padded");
+static_assert(sizeof(ResultMarker) == 72, "ResultMarker must not be padded");
+
+runtime_error writeError(const QFile& file)
+{
+    return runtime_error{"Unable to write to " + file.fileName().toStdString() + ": " + file.errorString().toStdString()};
+}
+
+void writeAll(QFile& file, const void* data, size_t size)
+{
+    if (file.write(static_cast<const char*>(data), static_cast<qint64>(size)) != static_cast<qint64>(size))
+        throw writeError(file);
+}
+
+}
+
+ResultRecorder::ResultRecorder(const QString& fileName)
+    : m_file{fileName}
+    , m_frameCount{0}
+{
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        throw runtime_error{"Unable to open " + fileName.toStdString() + " for writing"};
+
+    ResultFileHeader header;
+    memcpy(header.magic, resultFileMagic, sizeof(header.magic));
+    header.version = resultFileVersion;
+    header.headerSize = sizeof(ResultFileHeader);
+
+    writeAll(m_file, &header, sizeof(header));
+}
+
+void ResultRecorder::record(uint32_t frame, int64_t timestamp, const MarkerResults& markers)
+{
+    ResultRecordHeader header;
+    header.frame = frame;
+    header.count = static_cast<uint32_t>(markers.size());
+    header.timestamp = timestamp;
+
+    m_markers.resize(header.count);
+
+    for (int i = 0; i < markers.size(); ++i)
+    {
+        auto& marker = m_markers[i];
+
+        marker.id = markers.ids[i];
+        memcpy(marker.corners, markers.corners[i], sizeof(marker.corners));
+        memcpy(marker.rotation, markers.rotations[i], sizeof(marker.rotation));
+        memcpy(marker.translation, markers.translations[i], sizeof(marker.translation));
+        marker.confidence = markers.confidences[i];
+        marker.reserved = 0;
+    }
+
+    writeAll(m_file, &header, sizeof(header));
+    writeAll(m_file, m_markers.data(), m_markers.size() * sizeof(ResultMarker));
+    ++m_frameCount;
+}
+
+void ResultRecorder::finish()
+{
+    if (!m_file.flush())
+        throw writeError(m_file);
+
+    m_file.close();
+
+    if (m_file.error() != QFileDevice::NoError)
+        throw writeError(m_file);
+}
+
+BatchDetector::BatchDetector(shared_ptr<const MarksDetector> detector)
+    : m_detector{std::move(detector)}
+    , m_threads{0}
+    , m_chunkSize{32}
+{
+    if (!m_detector)
+        throw invalid_argument{"BatchDetector needs a detector"};
+}
+
+void BatchDetector::run(size_t frameCount, const FrameSource& frames, const ResultSink& sink) const
+{
+    const size_t chunkSize = std::max<size_t>(m_chunkSize, 1);
+    const size_t chunks = (frameCount + chunkSize - 1) / chunkSize;
+
+    if (chunks == 0)
+        return;
+
+    const auto cores = static_cast<size_t>(std::max(static_cast<int>(thread::hardware_concurrency()), 1));
+    const auto threadCount = std::min(m_threads > 0 ? static_cast<size_t>(m_threads) : cores, chunks);
+
+    // Workers stay at most this many chunks ahead of the sink, so that the
+    // memory used does not grow with the length of the footage
+    const size_t maxAhead = 2 * threadCount;
+
+    mutex lock;
+    condition_variable changed;
+    size_t nextChunk = 0;
+    size_t delivered = 0;
+    map<size_t, vector<MarkerResults>> finished;
+    exception_ptr failure;
+
+    const auto worker = [&]
+    {
+        for (;;)
+        {
+            size_t chunk;
+            {
+                unique_lock<mutex> guard{lock};
+                changed.wait(guard, [&] { return failure || nextChunk == chunks || nextChunk < delivered + maxAhead; });
+
+                if (failure || nextChunk == chunks)
+                    return;
+
+                chunk = nextChunk++;
+            }
+
+            const size_t first = chunk * chunkSize;
+            const size_t last = std::min(first + chunkSize, frameCount);
+            vector<MarkerResults> results;
+
+            try
+            {
+                DetectorScratch scratch;
+                scratch.setEffort(m_effort);
+                results.reserve(last - first);
+
+                for (size_t i = first; i < last; ++i)
+                    results.push_back(m_detector->detect(frames(i), scratch));
+            }
+            catch(...)
+            {
+                lock_guard<mutex> guard{lock};
+
+                if (!failure)
+                    failure = current_exception();
+
+                changed.notify_all();
+                return;
+            }
+
+            {
+                lock_guard<mutex> guard{lock};
+                finished[chunk] = std::move(results);
+            }
+
+            changed.notify_all();
+        }
+    };
+
+    vector<thread> pool;
+
+    try
+    {
+        for (size_t i = 0; i < threadCount; ++i)
+            pool.emplace_back(worker);
+
+        while (delivered < chunks)
+        {
+            vector<MarkerResults> results;
+            {
+                unique_lock<mutex> guard{lock};
+                changed.wait(guard, [&] { return failure || finished.count(delivered); });
+
+                if (failure)
+                    break;
+
+                results = std::move(finished[delivered]);
+                finished.erase(delivered);
+            }
+
+            const size_t first = delivered * chunkSize;
+
+            for (size_t i = 0; i < results.size(); ++i)
+                sink(first + i, results[i]);
+
+            {
+                lock_guard<mutex> guard{lock};
+                ++delivered;
+            }
+
+            changed.notify_all();
+        }
+    }
+    catch(...)
+    {
+        // The sink failed or a worker could not be started, stop the
+        // workers already running before passing the error on
+        lock_guard<mutex> guard{lock};
+
+        if (!failure)
+            failure = current_exception();
+
+        changed.notify_all();
+    }
+
+    for (auto& t : pool)
+        t.join();
+
+    if (failure)
+        rethrow_exception(failure);
+}
@@ -0,0 +1,356 @@
+// Copyright (c) 2017 Elvis Dukaj
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "cornerrefiner.h"
+#include "markerlayout.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define CORNER_REFINER_SSE2
+#endif
+
+using namespace cv;
+using namespace std;
+
+namespace {
+
+// Squared distance under which a raw corner counts as not moved, and squared
+// displacement under which the refinement of a corner has converged
+const float trackingTolerance = 0.25f;
+const float convergenceTolerance = 0.0001f;
+
+// Sums over the window of the gradient products, weighted by the mask and,
+// for bx and by, by the position relative to the window center
+struct Moments {
+    float gxx = 0.0f;
+    float gxy = 0.0f;
+    float gyy = 0.0f;
+    float bx = 0.0f;
+    float by = 0.0f;
+};
+
+#if defined(CORNER_REFINER_SSE2)
+float horizontalSum(__m128 v) noexcept
+{
+    v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+    return _mm_cvtss_f32(v);
+}
+#endif
+
+// patch is the (2 * halfWindow + 3)^2 neighbourhood of the corner, gradients
+// are central differences so that the window keeps a one pixel margin
+Moments gradientMoments(const float* patch, const float* mask, int halfWindow) noexcept
+{
+    const int winSize = 2 * halfWindow + 1;
+    const int stride = winSize + 2;
+
+    Moments moments;
+
+    for (int i = 0; i < winSize; ++i)
+    {
+        const float* above = patch + i * stride + 1;
+        const float* row = patch + (i + 1) * stride;
+        const float* below = patch + (i + 2) * stride + 1;
+        const float* weights = mask + i * winSize;
+        const float py = static_cast<float>(i - halfWindow);
+
+        int j = 0;
+
+#if defined(CORNER_REFINER_SSE2)
+        __m128 gxx = _mm_setzero_ps(), gxy = _mm_setzero_ps(), gyy = _mm_setzero_ps();
+        __m128 bx = _mm_setzero_ps(), by = _mm_setzero_ps();
+        __m128 px = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+        px = _mm_sub_ps(px, _mm_set1_ps(static_cast<float>(halfWindow)));
+        const __m128 pys = _mm_set1_ps(py);
+        const __m128 four = _mm_set1_ps(4.0f);
+
+        for (; j + 4 <= winSize; j += 4)
+        {
+            const __m128 tgx = _mm_sub_ps(_mm_loadu_ps(row + j + 2), _mm_loadu_ps(row + j));
+            const __m128 tgy = _mm_sub_ps(_mm_loadu_ps(below + j), _mm_loadu_ps(above + j));
+            const __m128 m = _mm_loadu_ps(weights + j);
+
+            const __m128 xx = _mm_mul_ps(_mm_mul_ps(tgx, tgx), m);
+            const __m128 xy = _mm_mul_ps(_mm_mul_ps(tgx, tgy), m);
+            const __m128 yy = _mm_mul_ps(_mm_mul_ps(tgy, tgy), m);
+
+            gxx = _mm_add_ps(gxx, xx);
+            gxy = _mm_add_ps(gxy, xy);
+            gyy = _mm_add_ps(gyy, yy);
+            bx = _mm_add_ps(bx, _mm_add_ps(_mm_mul_ps(xx, px), _mm_mul_ps(xy, pys)));
+            by = _mm_add_ps(by, _mm_add_ps(_mm_mul_ps(xy, px), _mm_mul_ps(yy, pys)));
+
+            px = _mm_add_ps(px, four);
+        }
+
+        moments.gxx += horizontalSum(gxx);
+        moments.gxy += horizontalSum(gxy);
+        moments.gyy += horizontalSum(gyy);
+        moments.bx += horizontalSum(bx);
+        moments.by += horizontalSum(by);
+#endif
+
+        for (; j < winSize; ++j)
+        {
+            const float tgx = row[j + 2] - row[j];
+            const float tgy = below[j] - above[j];
+            const float m = weights[j];
+            const float px = static_cast<float>(j - halfWindow);
+
+            const float xx = tgx * tgx * m;
+            const float xy = tgx * tgy * m;
+            const float yy = tgy * tgy * m;
+
+            moments.gxx += xx;
+            moments.gxy += xy;
+            moments.gyy += yy;
+            moments.bx += xx * px + xy * py;
+            moments.by += xy * px + yy * py;
+        }
+    }
+
+    return moments;
+}
+
+}
+
+CornerRefiner::CornerRefiner()
+    : m_previousCount{0}
+    , m_refinedCorners{0}
+{
+    // Same weights as cv::cornerSubPix: a Gaussian falling to exp(-1) at the
+    // border of the window
+    for (int w = 0; w <= maxHalfWindow; ++w)
+    {
+        const int winSize = 2 * w + 1;
+        const float coeff = w > 0 ? 1.0f / static_cast<float>(w * w) : 0.0f;
+
+        auto& mask = m_masks[w];
+        mask.resize(static_cast<size_t>(winSize) * winSize);
+
+        for (int i = 0; i < winSize; ++i)
+            for (int j = 0; j < winSize; ++j)
+            {
+                const float y = static_cast<float>(i - w);
+                const float x = static_cast<float>(j - w);
+                mask[i * winSize + j] = std::exp(-x * x * coeff) * std::exp(-y * y * coeff);
+            }
+    }
+}
+
+void CornerRefiner::reset() noexcept
+{
+    m_previousCount = 0;
+}
+
+int CornerRefiner::previousIndex(uint64_t id) const noexcept
+{
+    for (int p = 0; p < m_previousCount; ++p)
+        if (m_previousIds[p] == id)
+            return p;
+
+    return -1;
+}
+
+bool CornerRefiner::moved(const MarkerResults& markers, int i, int previous) const noexcept
+{
+    for (int c = 0; c < 4; ++c)
+    {
+        const float dx = markers.corners[i][c][0] - m_previousRaw[previous][c][0];
+        const float dy = markers.corners[i][c][1] - m_previousRaw[previous][c][1];
+
+        if (dx * dx + dy * dy > trackingTolerance)
+            return true;
+    }
+
+    return false;
+}
+
+void CornerRefiner::refine(const Mat& grayscale, MarkerResults& markers, int maxIterations, int first)
+{
+    CV_Assert(grayscale.type() == CV_8UC1);
+
+    m_corners.clear();
+    m_refinedCorners = 0;
+
+    if (maxIterations <= 0)
+    {
+        reset();
+        return;
+    }
+
+    float raw[MarkerResults::capacity][4][2];
+    float refined[MarkerResults::capacity][4][2];
+
+    copy(&markers.corners[0][0][0], &markers.corners[0][0][0] + 8 * markers.size(), &raw[0][0][0]);
+    copy(&markers.corners[0][0][0], &markers.corners[0][0][0] + 8 * markers.size(), &refined[0][0][0]);
+
+    for (int i = 0; i < markers.size(); ++i)
+    {
+        const int previous = previousIndex(markers.ids[i]);
+
+        // Markers already refined keep the raw corners they were refined from
+        if (i < first)
+        {
+            if (previous >= 0)
+                copy(&m_previousRaw[previous][0][0], &m_previousRaw[previous][0][0] + 8, &raw[i][0][0]);
+
+            continue;
+        }
+
+        // A still marker keeps the refinement of the previous frame
+        if (previous >= 0 && !moved(markers, i, previous))
+        {
+            copy(&m_previousRefined[previous][0][0], &m_previousRefined[previous][0][0] + 8, &refined[i][0][0]);
+            continue;
+        }
+
+        // Windows span about one cell of the marker: half a cell on each
+        // side of the corner, which the black border alone fills inside
+        float side = 0.0f;
+
+        for (int c = 0; c < 4; ++c)
+        {
+            const auto edge = markers.corner(i, (c + 1) % 4) - markers.corner(i, c);
+            side += std::sqrt(edge.dot(edge)) / 4.0f;
+        }
+
+        const float cellSide = side / static_cast<float>(DefaultMarkerLayout::gridSize);
+        const int halfWindow = std::min(std::max(static_cast<int>(cellSide / 2.0f), static_cast<int>(minHalfWindow)),
+                                        static_cast<int>(maxHalfWindow));
+
+        // Small windows converge in a few steps
+        const int iterations = std::min(maxIterations, 2 * halfWindow + 2);
+
+        for (int c = 0; c < 4; ++c)
+            m_corners.push_back(Corner{i, c, markers.corners[i][c][0], markers.corners[i][c][1], halfWindow, iterations});
+    }
+
+    for (auto& corner : m_corners)
+    {
+        refineCorner(grayscale, corner);
+        refined[corner.marker][corner.index][0] = corner.x;
+        refined[corner.marker][corner.index][1] = corner.y;
+    }
+
+    m_refinedCorners = static_cast<int>(m_corners.size());
+
+    // Raw corners are remembered for the next frame
+    m_previousCount = markers.size();
+    copy(begin(markers.ids), begin(markers.ids) + markers.size(), begin(m_previousIds));
+    copy(&raw[0][0][0], &raw[0][0][0] + 8 * markers.size(), &m_previousRaw[0][0][0]);
+    copy(&refined[0][0][0], &refined[0][0][0] + 8 * markers.size(), &m_previousRefined[0][0][0]);
+    copy(&refined[0][0][0], &refined[0][0][0] + 8 * markers.size(), &markers.corners[0][0][0]);
+}
+
+void CornerRefiner::refineCorner(const Mat& grayscale, Corner& corner)
+{
+    const int w = corner.halfWindow;
+    const float* mask = m_masks[w].data();
+    const float startX = corner.x;
+    const float startY = corner.y;
+
+    float x = startX;
+    float y = startY;
+
+    for (int iteration = 0; iteration < corner.iterations; ++iteration)
+    {
+        samplePatch(grayscale, x, y, 2 * w + 3);
+        const auto moments = gradientMoments(m_patch.data(), mask, w);
+
+        const double det = static_cast<double>(moments.gxx) * moments.gyy - static_cast<double>(moments.gxy) * moments.gxy;
+
+        if (std::abs(det) <= DBL_EPSILON * DBL_EPSILON)
+            break;
+
+        const double scale = 1.0 / det;
+        const auto nextX = static_cast<float>(x + moments.gyy * scale * moments.bx - moments.gxy * scale * moments.by);
+        const auto nextY = static_cast<float>(y - moments.gxy * scale * moments.bx + moments.gxx * scale * moments.by);
+        const float error = (nextX - x) * (nextX - x) + (nextY - y) * (nextY - y);
+
+        x = nextX;
+        y = nextY;
+
+        if (x < 0.0f || x >= grayscale.cols || y < 0.0f || y >= grayscale.rows || error <= convergenceTolerance)
+            break;
+    }
+
+    // A corner walking out of its window is not trusted
+    if (std::abs(x - startX) > w || std::abs(y - startY) > w)
+        return;
+
+    corner.x = x;
+    corner.y = y;
+}
+
+void CornerRefiner::samplePatch(const Mat& grayscale, float x, float y, int size)
+{
+    // Bilinear samples centered on (x, y), the border replicated as
+    // cv::getRectSubPix does
+    const float left = x - (size - 1) * 0.5f;
+    const float top = y - (size - 1) * 0.5f;
+    const int ix = static_cast<int>(std::floor(left));
+    const int iy = static_cast<int>(std::floor(top));
+    const float a = left - ix;
+    const float b = top - iy;
+
+    const float w00 = (1.0f - a) * (1.0f - b);
+    const float w01 = a * (1.0f - b);
+    const float w10 = (1.0f - a) * b;
+    const float w11 = a * b;
+
+    m_patch.resize(static_cast<size_t>(size) * size);
+
+    const bool inside = ix >= 0 && iy >= 0 && ix + size < grayscale.cols && iy + size < grayscale.rows;
+
+    for (int i = 0; i < size; ++i)
+    {
+        float* patch = m_patch.data() + i * size;
+
+        if (inside)
+        {
+            const uchar* row0 = grayscale.ptr<uchar>(iy + i) + ix;
+            const uchar* row1 = grayscale.ptr<uchar>(iy + i + 1) + ix;
+
+            for (int j = 0; j < size; ++j)
+                patch[j] = w00 * row0[j] + w01 * row0[j + 1] + w10 * row1[j] + w11 * row1[j + 1];
+
+            continue;
+        }
+
+        const uchar* row0 = grayscale.ptr<uchar>(std::min(std::max(iy + i, 0), grayscale.rows - 1));
+        const uchar* row1 = grayscale.ptr<uchar>(std::min(std::max(iy + i + 1, 0), grayscale.rows - 1));
+
+        for (int j = 0; j < size; ++j)
+        {
+            const int x0 = std::min(std::max(ix + j, 0), grayscale.cols - 1);
+            const int x1 = std::min(std::max(ix + j + 1, 0), grayscale.cols - 1);
+
+            patch[j] = w00 * row0[x0] + w01 * row0[x1] + w10 * row1[x0] + w11 * row1[x1];
+        }
+    }
+}
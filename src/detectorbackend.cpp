@@ -0,0 +1,271 @@
+// Copyright (c) 2017 Elvis Dukaj
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "detectorbackend.h"
+#include "packedbinaryimage.h"
+#include "runlengthquaddetector.h"
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+
+#if defined(MARKERDETECTOR_WITH_ARUCO)
+#include <opencv2/aruco.hpp>
+#endif
+
+using namespace cv;
+using namespace std;
+
+namespace {
+
+// Each region is binarized with its own Otsu threshold, contours are traced
+// with cv::findContours and approximated by polygons
+class ContourBackend : public DetectorBackend {
+public:
+    const char* name() const noexcept override { return "contours"; }
+
+    void binarize(const Mat& image, const vector<Rect>& regions) override
+    {
+        m_regions = regions;
+        m_binarized.create(image.size(), CV_8UC1);
+
+        // Candidates are warped from the whole image, the pixels around a
+        // region they may reach must not hold the garbage of an earlier frame.
+        // Regions never overlap, they cover the image when their areas do.
+        int covered = 0;
+
+        for (const auto& region : m_regions)
+            covered += region.area();
+
+        if (covered < image.rows * image.cols)
+            m_binarized.setTo(Scalar{0});
+
+        for (const auto& region : m_regions)
+        {
+            Mat binarizedRegion = m_binarized(region);
+            threshold(image(region), binarizedRegion, 127, 255.0, THRESH_BINARY | THRESH_OTSU);
+        }
+    }
+
+    void findQuads(float minSquaredSideLength, vector<vector<Point2f>>& quads, DetectorStats& stats) override
+    {
+        m_contours.clear();
+
+        for (const auto& region : m_regions)
+        {
+            cv::findContours(m_binarized(region), m_regionContours, RETR_LIST, CHAIN_APPROX_NONE, region.tl());
+            std::move(begin(m_regionContours), end(m_regionContours), back_inserter(m_contours));
+        }
+
+        stats.add(DetectorStats::Counter::Contours, m_contours.size());
+
+        const auto first = quads.size();
+        uint64_t notQuad = 0, notConvex = 0, tooSmall = 0;
+
+        // For each contour, analyze if it is a parallelepiped likely to be the marker
+        for (const auto& contour : m_contours)
+        {
+            // Approximate to a polygon
+            double eps = contour.size() * 0.05;
+            approxPolyDP(contour, m_approxCurve, eps, true);
+
+            // We interested only in polygons that contains only four points
+            if (m_approxCurve.size() != 4)
+            {
+                ++notQuad;
+                continue;
+            }
+
+            // And they have to be convex
+            if (!isContourConvex(m_approxCurve))
+            {
+                ++notConvex;
+                continue;
+            }
+
+            // Ensure that the distance between consecutive points is large enough
+            float minDist = std::numeric_limits<float>::max();
+
+            for (int i = 0; i < 4; i++)
+            {
+                Point2f side = m_approxCurve[i] - m_approxCurve[(i+1)%4];
+                minDist = std::min(minDist, side.dot(side));
+            }
+
+            if (minDist < minSquaredSideLength)
+            {
+                ++tooSmall;
+                continue;
+            }
+
+            quads.push_back(m_approxCurve);
+        }
+
+        stats.add(DetectorStats::Counter::RejectedNotQuad, notQuad);
+        stats.add(DetectorStats::Counter::RejectedNotConvex, notConvex);
+        stats.add(DetectorStats::Counter::RejectedTooSmall, tooSmall);
+        stats.add(DetectorStats::Counter::Quads, quads.size() - first);
+    }
+
+    Mat binarized() const override { return m_binarized; }
+
+private:
+    vector<Rect> m_regions;
+    Mat m_binarized;
+    vector<vector<Point>> m_regionContours;
+    vector<vector<Point>> m_contours;
+    vector<Point2f> m_approxCurve;
+};
+
+// Regions are packed to one bit per pixel and labelled by
+// RunLengthQuadDetector, no contour is traced
+class RunLengthBackend : public DetectorBackend {
+public:
+    const char* name() const noexcept override { return "runlength"; }
+
+    void binarize(const Mat& image, const vector<Rect>& regions) override
+    {
+        m_regions = regions;
+        m_packedRegions.resize(m_regions.size());
+
+        for (size_t i = 0; i < m_regions.size(); ++i)
+        {
+            const Mat region = image(m_regions[i]);
+            m_packedRegions[i].threshold(region, otsuThreshold(region));
+        }
+    }
+
+    void findQuads(float minSquaredSideLength, vector<vector<Point2f>>& quads, DetectorStats& stats) override
+    {
+        const auto first = quads.size();
+
+        for (size_t i = 0; i < m_regions.size(); ++i)
+            m_detector.detect(m_packedRegions[i], m_regions[i].tl(), minSquaredSideLength, quads);
+
+        stats.add(DetectorStats::Counter::Quads, quads.size() - first);
+    }
+
+private:
+    vector<Rect> m_regions;
+    vector<PackedBinaryImage> m_packedRegions;
+    RunLengthQuadDetector m_detector;
+};
+
+#if defined(MARKERDETECTOR_WITH_ARUCO)
+// Candidate search of the aruco module: adaptive thresholding at several
+// window sizes and contour filtering. Both the aruco markers it recognizes
+// and the quads it rejects are candidates, their bits are not ours.
+class ArucoBackend : public DetectorBackend {
+public:
+    ArucoBackend()
+        : m_dictionary{aruco::getPredefinedDictionary(aruco::DICT_4X4_50)}
+        , m_parameters{makePtr<aruco::DetectorParameters>()}
+    {
+    }
+
+    const char* name() const noexcept override { return "aruco"; }
+
+    void binarize(const Mat& image, const vector<Rect>& regions) override
+    {
+        // aruco thresholds on its own
+        m_image = image;
+        m_regions = regions;
+    }
+
+    void findQuads(float minSquaredSideLength, vector<vector<Point2f>>& quads, DetectorStats& stats) override
+    {
+        const auto first = quads.size();
+        uint64_t tooSmall = 0;
+
+        for (const auto& region : m_regions)
+        {
+            aruco::detectMarkers(m_image(region), m_dictionary, m_corners, m_ids, m_parameters, m_rejected);
+            m_corners.insert(end(m_corners), begin(m_rejected), end(m_rejected));
+
+            for (auto& quad : m_corners)
+            {
+                float minDist = std::numeric_limits<float>::max();
+
+                for (int i = 0; i < 4; i++)
+                {
+                    Point2f side = quad[i] - quad[(i+1)%4];
+                    minDist = std::min(minDist, side.dot(side));
+                }
+
+                if (minDist < minSquaredSideLength)
+                {
+                    ++tooSmall;
+                    continue;
+                }
+
+                for (auto& corner : quad)
+                    corner += Point2f{static_cast<float>(region.x), static_cast<float>(region.y)};
+
+                quads.push_back(quad);
+            }
+        }
+
+        stats.add(DetectorStats::Counter::RejectedTooSmall, tooSmall);
+        stats.add(DetectorStats::Counter::Quads, quads.size() - first);
+    }
+
+private:
+    Ptr<aruco::Dictionary> m_dictionary;
+    Ptr<aruco::DetectorParameters> m_parameters;
+    Mat m_image;
+    vector<Rect> m_regions;
+    vector<vector<Point2f>> m_corners;
+    vector<vector<Point2f>> m_rejected;
+    vector<int> m_ids;
+};
+#endif
+
+}
+
+vector<string> DetectorBackend::available()
+{
+    return {
+        "contours",
+        "runlength",
+#if defined(MARKERDETECTOR_WITH_ARUCO)
+        "aruco",
+#endif
+    };
+}
+
+unique_ptr<DetectorBackend> DetectorBackend::create(const string& name)
+{
+    if (name == "contours")
+        return make_unique<ContourBackend>();
+
+    if (name == "runlength")
+        return make_unique<RunLengthBackend>();
+
+#if defined(MARKERDETECTOR_WITH_ARUCO)
+    if (name == "aruco")
+        return make_unique<ArucoBackend>();
+#endif
+
+    throw std::runtime_error{"unknown detector back-end " + name};
+}
@@ -0,0 +1,229 @@
+// Copyright (c) 2017 Elvis Dukaj
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "detectorstats.h"
+#include "bitops.h"
+#include <algorithm>
+#include <iomanip>
+
+using namespace std;
+
+namespace {
+
+size_t bucketIndex(uint64_t value) noexcept
+{
+    const uint64_t largest = (uint64_t{1} << 32) - 1;
+    value = std::min(value, largest);
+
+    if (value < LatencyHistogram::subBuckets)
+        return static_cast<size_t>(value);
+
+    const int magnitude = mostSignificantBit(value) - LatencyHistogram::subBucketBits + 1;
+    const auto subBucket = (value >> (magnitude - 1)) - LatencyHistogram::subBuckets;
+
+    return static_cast<size_t>(magnitude) * LatencyHistogram::subBuckets + static_cast<size_t>(subBucket);
+}
+
+// Highest value that falls in the given bucket
+uint64_t bucketValue(size_t index) noexcept
+{
+    const auto magnitude = static_cast<int>(index / LatencyHistogram::subBuckets);
+    const auto subBucket = static_cast<uint64_t>(index % LatencyHistogram::subBuckets);
+
+    if (magnitude == 0)
+        return subBucket;
+
+    const auto lowest = (subBucket + LatencyHistogram::subBuckets) << (magnitude - 1);
+    return lowest + (uint64_t{1} << (magnitude - 1)) - 1;
+}
+
+const char* const stageNames[] = {
+    "binarize",
+    "contours",
+    "candidates",
+    "recognize",
+    "refine",
+    "pose",
+    "frame"
+};
+
+const char* const counterNames[] = {
+    "frames",
+    "unchangedFrames",
+    "contours",
+    "quads",
+    "rejectedNotQuad",
+    "rejectedNotConvex",
+    "rejectedTooSmall",
+    "rejectedTooNear",
+    "rejectedOutsideRegion",
+    "rejectedOverCap",
+    "rejectedBorder",
+    "rejectedOrientation",
+    "crcFailures",
+    "validMarkers"
+};
+
+static_assert(sizeof(stageNames) / sizeof(stageNames[0]) == static_cast<size_t>(DetectorStats::Stage::Count),
+              "every stage needs a name");
+static_assert(sizeof(counterNames) / sizeof(counterNames[0]) == static_cast<size_t>(DetectorStats::Counter::Count),
+              "every counter needs a name");
+
+}
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+void LatencyHistogram::record(chrono::microseconds value) noexcept
+{
+    const auto v = static_cast<uint64_t>(std::max<int64_t>(value.count(), 0));
+
+    m_buckets[bucketIndex(v)].fetch_add(1, memory_order_relaxed);
+
+    auto previous = m_max.load(memory_order_relaxed);
+    while (previous < v && !m_max.compare_exchange_weak(previous, v, memory_order_relaxed))
+        ;
+}
+
+void LatencyHistogram::reset() noexcept
+{
+    for (auto& bucket : m_buckets)
+        bucket.store(0, memory_order_relaxed);
+
+    m_max.store(0, memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::count() const noexcept
+{
+    uint64_t total = 0;
+
+    for (const auto& bucket : m_buckets)
+        total += bucket.load(memory_order_relaxed);
+
+    return total;
+}
+
+chrono::microseconds LatencyHistogram::max() const noexcept
+{
+    return chrono::microseconds{static_cast<int64_t>(m_max.load(memory_order_relaxed))};
+}
+
+chrono::microseconds LatencyHistogram::percentile(double fraction) const noexcept
+{
+    // Take a snapshot first, the detector keeps recording meanwhile
+    array<uint64_t, bucketCount> snapshot;
+    uint64_t total = 0;
+
+    for (size_t i = 0; i < snapshot.size(); ++i)
+    {
+        snapshot[i] = m_buckets[i].load(memory_order_relaxed);
+        total += snapshot[i];
+    }
+
+    if (total == 0)
+        return chrono::microseconds{0};
+
+    const auto wanted = std::max<uint64_t>(static_cast<uint64_t>(fraction * total + 0.5), 1);
+    const auto largest = m_max.load(memory_order_relaxed);
+    uint64_t seen = 0;
+
+    for (size_t i = 0; i < snapshot.size(); ++i)
+    {
+        seen += snapshot[i];
+
+        if (seen >= wanted)
+            return chrono::microseconds{static_cast<int64_t>(std::min(bucketValue(i), largest))};
+    }
+
+    return max();
+}
+
+DetectorStats::DetectorStats()
+{
+    reset();
+}
+
+void DetectorStats::record(Stage stage, chrono::microseconds duration) noexcept
+{
+    m_histograms[static_cast<size_t>(stage)].record(duration);
+}
+
+void DetectorStats::add(Counter counter, uint64_t value) noexcept
+{
+    m_counters[static_cast<size_t>(counter)].fetch_add(value, memory_order_relaxed);
+}
+
+const LatencyHistogram& DetectorStats::histogram(Stage stage) const noexcept
+{
+    return m_histograms[static_cast<size_t>(stage)];
+}
+
+uint64_t DetectorStats::counter(Counter counter) const noexcept
+{
+    return m_counters[static_cast<size_t>(counter)].load(memory_order_relaxed);
+}
+
+void DetectorStats::reset() noexcept
+{
+    for (auto& histogram : m_histograms)
+        histogram.reset();
+
+    for (auto& counter : m_counters)
+        counter.store(0, memory_order_relaxed);
+}
+
+void DetectorStats::dump(ostream& os) const
+{
+    os << left << setw(12) << "stage (us)" << right
+       << setw(12) << "count" << setw(10) << "p50" << setw(10) << "p99"
+       << setw(10) << "p999" << setw(10) << "max" << '\n';
+
+    for (size_t i = 0; i < m_histograms.size(); ++i)
+    {
+        const auto& h = m_histograms[i];
+
+        os << left << setw(12) << stageNames[i] << right
+           << setw(12) << h.count()
+           << setw(10) << h.percentile(0.5).count()
+           << setw(10) << h.percentile(0.99).count()
+           << setw(10) << h.percentile(0.999).count()
+           << setw(10) << h.max().count() << '\n';
+    }
+
+    for (size_t i = 0; i < m_counters.size(); ++i)
+        os << left << setw(22) << counterNames[i] << right << setw(12) << m_counters[i].load(memory_order_relaxed) << '\n';
+
+    os.flush();
+}
+
+const char* DetectorStats::name(Stage stage) noexcept
+{
+    return stageNames[static_cast<size_t>(stage)];
+}
+
+const char* DetectorStats::name(Counter counter) noexcept
+{
+    return counterNames[static_cast<size_t>(counter)];
+}
@@ -0,0 +1,86 @@
+// Copyright (c) 2017 Elvis Dukaj
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "framechangedetector.h"
+#include <opencv2/imgproc.hpp>
+
+using namespace cv;
+using namespace std;
+
+FrameChangeDetector::FrameChangeDetector()
+    : m_threshold{8}
+    , m_hasReference{false}
+{
+}
+
+void FrameChangeDetector::reset() noexcept
+{
+    m_hasReference = false;
+}
+
+bool FrameChangeDetector::update(const Mat& grayscale)
+{
+    const Rect frameRect{Point{0, 0}, grayscale.size()};
+    const Size thumbnailSize{(grayscale.cols + blockSize - 1) / blockSize, (grayscale.rows + blockSize - 1) / blockSize};
+
+    resize(grayscale, m_thumbnail, thumbnailSize, 0.0, 0.0, INTER_AREA);
+
+    m_changedRegions.clear();
+
+    if (!m_hasReference || m_reference.size() != m_thumbnail.size())
+    {
+        m_thumbnail.copyTo(m_reference);
+        m_hasReference = true;
+        m_changedRegions.push_back(frameRect);
+        return true;
+    }
+
+    absdiff(m_thumbnail, m_reference, m_difference);
+    cv::threshold(m_difference, m_changedBlocks, m_threshold, 255, THRESH_BINARY);
+
+    // The reference is only moved forward on change, so that a slow drift
+    // eventually adds up to a change
+    if (countNonZero(m_changedBlocks) == 0)
+        return false;
+
+    m_thumbnail.copyTo(m_reference);
+
+    dilate(m_changedBlocks, m_changedBlocks, Mat{});
+
+    const int components = connectedComponentsWithStats(m_changedBlocks, m_labels, m_componentStats, m_centroids, 8, CV_32S);
+
+    // Label 0 is the background
+    for (int i = 1; i < components; ++i)
+    {
+        const Rect blocks{
+            m_componentStats.at<int>(i, CC_STAT_LEFT), m_componentStats.at<int>(i, CC_STAT_TOP),
+            m_componentStats.at<int>(i, CC_STAT_WIDTH), m_componentStats.at<int>(i, CC_STAT_HEIGHT)
+        };
+
+        m_changedRegions.push_back(Rect{
+            blocks.x * blockSize, blocks.y * blockSize, blocks.width * blockSize, blocks.height * blockSize
+        } & frameRect);
+    }
+
+    return true;
+}
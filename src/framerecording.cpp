@@ -0,0 +1,157 @@
+// Copyright (c) 2017 Elvis Dukaj
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "framerecording.h"
+#include <cstring>
+#include <stdexcept>
+
+using namespace cv;
+using namespace std;
+
+namespace {
+
+const char frameFileMagic[8] = {'M', 'K', 'F', 'R', 'A', 'M', 'E', 'S'};
+const uint32_t frameFileVersion = 1;
+const size_t recordAlignment = 16;
+
+size_t paddedRecordPayload(size_t payload)
+{
+    auto total = sizeof(FrameRecordHeader) + payload;
+    auto padded = (total + recordAlignment - 1) / recordAlignment * recordAlignment;
+    return padded - sizeof(FrameRecordHeader);
+}
+
+// Records follow each other: a short write would leave a record that the
+// replay reads as the beginning of the next one
+void writeAll(QFile& file, const void* data, size_t size)
+{
+    if (file.write(static_cast<const char*>(data), static_cast<qint64>(size)) != static_cast<qint64>(size))
+        throw runtime_error{"Unable to write to " + file.fileName().toStdString() + ": " + file.errorString().toStdString()};
+}
+
+}
+
+FrameRecorder::FrameRecorder(const QString& fileName)
+    : m_file{fileName}
+    , m_start{chrono::steady_clock::now()}
+    , m_padding(recordAlignment, 0)
+    , m_frameCount{0}
+{
+    // Unbuffered, a full disk fails the write of the frame instead of a
+    // later flush nobody checks
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered))
+        throw runtime_error{"Unable to open " + fileName.toStdString() + " for recording"};
+
+    FrameFileHeader header;
+    memcpy(header.magic, frameFileMagic, sizeof(header.magic));
+    header.version = frameFileVersion;
+    header.headerSize = sizeof(FrameFileHeader);
+
+    writeAll(m_file, &header, sizeof(header));
+}
+
+void FrameRecorder::record(const Mat& grayscale)
+{
+    CV_Assert(grayscale.type() == CV_8UC1);
+
+    const auto payload = static_cast<size_t>(grayscale.cols) * grayscale.rows;
+    const auto elapsed = chrono::steady_clock::now() - m_start;
+
+    FrameRecordHeader header;
+    header.timestamp = chrono::duration_cast<chrono::microseconds>(elapsed).count();
+    header.width = grayscale.cols;
+    header.height = grayscale.rows;
+    header.stride = grayscale.cols;
+    header.dataSize = static_cast<uint32_t>(paddedRecordPayload(payload));
+
+    writeAll(m_file, &header, sizeof(header));
+
+    if (grayscale.isContinuous())
+        writeAll(m_file, grayscale.data, payload);
+    else
+        for (int y = 0; y < grayscale.rows; ++y)
+            writeAll(m_file, grayscale.ptr(y), static_cast<size_t>(grayscale.cols));
+
+    writeAll(m_file, m_padding.data(), header.dataSize - payload);
+    ++m_frameCount;
+}
+
+FrameReplay::FrameReplay(const QString& fileName)
+    : m_file{fileName}
+    , m_data{nullptr}
+{
+    if (!m_file.open(QIODevice::ReadOnly))
+        throw runtime_error{"Unable to open " + fileName.toStdString()};
+
+    const auto fileSize = static_cast<size_t>(m_file.size());
+
+    if (fileSize < sizeof(FrameFileHeader))
+        throw runtime_error{fileName.toStdString() + " is not a frame recording"};
+
+    m_data = m_file.map(0, m_file.size());
+
+    if (!m_data)
+        throw runtime_error{"Unable to map " + fileName.toStdString() + " in memory"};
+
+    const auto& header = *reinterpret_cast<const FrameFileHeader*>(m_data);
+
+    if (memcmp(header.magic, frameFileMagic, sizeof(header.magic)) != 0 || header.version != frameFileVersion)
+        throw runtime_error{fileName.toStdString() + " is not a frame recording"};
+
+    // Records start right after the header and stay aligned
+    if (header.headerSize < sizeof(FrameFileHeader) || header.headerSize > fileSize
+        || header.headerSize % recordAlignment != 0)
+        throw runtime_error{fileName.toStdString() + " is not a frame recording"};
+
+    // Index the records, a truncated last frame is silently dropped
+    size_t offset = header.headerSize;
+
+    while (offset + sizeof(FrameRecordHeader) <= fileSize)
+    {
+        auto record = reinterpret_cast<const FrameRecordHeader*>(m_data + offset);
+        offset += sizeof(FrameRecordHeader) + record->dataSize;
+
+        if (offset > fileSize)
+            break;
+
+        // Frames are read in place, a row must never reach past its record
+        if (record->width < 0 || record->height < 0 || record->stride < record->width
+            || static_cast<size_t>(record->stride) * record->height > record->dataSize)
+            throw runtime_error{fileName.toStdString() + " contains a corrupted frame"};
+
+        m_frames.push_back(record);
+    }
+}
+
+int64_t FrameReplay::timestamp(size_t index) const noexcept
+{
+    return m_frames[index]->timestamp;
+}
+
+Mat FrameReplay::frame(size_t index) const
+{
+    auto record = m_frames[index];
+    auto data = reinterpret_cast<const uchar*>(record + 1);
+
+    return Mat{record->height, record->width, CV_8UC1, const_cast<uchar*>(data), static_cast<size_t>(record->stride)};
+}
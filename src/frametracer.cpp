@@ -0,0 +1,219 @@
+// Copyright (c) 2017 Elvis Dukaj
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "frametracer.h"
+#include <iomanip>
+
+using namespace std;
+
+struct FrameTracer::BufferLease {
+    ThreadBuffer* buffer = nullptr;
+
+    ~BufferLease()
+    {
+        if (buffer)
+            FrameTracer::instance().releaseBuffer(buffer);
+    }
+};
+
+FrameTracer& FrameTracer::instance()
+{
+    static FrameTracer tracer;
+    return tracer;
+}
+
+FrameTracer::FrameTracer()
+    : m_enabled{false}
+    , m_generation{0}
+    , m_epoch{Clock::now().time_since_epoch().count()}
+{
+}
+
+void FrameTracer::start()
+{
+    // Buffers of an older generation are emptied by their own thread
+    // on the next event, so that every buffer keeps a single writer
+    m_epoch.store(Clock::now().time_since_epoch().count(), memory_order_relaxed);
+    m_generation.fetch_add(1, memory_order_release);
+    m_enabled.store(true, memory_order_release);
+}
+
+void FrameTracer::stop() noexcept
+{
+    m_enabled.store(false, memory_order_release);
+}
+
+void FrameTracer::complete(const char* name, Clock::time_point begin, Clock::time_point end, int64_t arg) noexcept
+{
+    if (!isEnabled())
+        return;
+
+    append(Event{name, 'X', begin, end, arg});
+}
+
+void FrameTracer::instant(const char* name, int64_t arg) noexcept
+{
+    if (!isEnabled())
+        return;
+
+    const auto now = Clock::now();
+    append(Event{name, 'i', now, now, arg});
+}
+
+FrameTracer::ThreadBuffer* FrameTracer::threadBuffer()
+{
+    thread_local BufferLease lease;
+
+    if (lease.buffer)
+        return lease.buffer;
+
+    lock_guard<mutex> lock{m_buffersMutex};
+
+    // A buffer outlives its thread: the capture of a finished thread is
+    // still part of the export, and the next thread appends after it. The
+    // number of buffers is bounded by the number of threads tracing at once.
+    if (!m_freeBuffers.empty())
+    {
+        lease.buffer = m_freeBuffers.back();
+        m_freeBuffers.pop_back();
+        return lease.buffer;
+    }
+
+    m_freeBuffers.reserve(m_buffers.size() + 1);
+
+    auto owned = make_unique<ThreadBuffer>();
+    owned->size = 0;
+    owned->generation = m_generation.load(memory_order_acquire);
+    owned->dropped = 0;
+    owned->threadId = static_cast<int>(m_buffers.size()) + 1;
+
+    lease.buffer = owned.get();
+    m_buffers.push_back(std::move(owned));
+
+    return lease.buffer;
+}
+
+void FrameTracer::releaseBuffer(ThreadBuffer* buffer) noexcept
+{
+    lock_guard<mutex> lock{m_buffersMutex};
+
+    // Reserved in advance, cannot throw
+    m_freeBuffers.push_back(buffer);
+}
+
+FrameTracer::Clock::time_point FrameTracer::epoch() const noexcept
+{
+    return Clock::time_point{Clock::duration{m_epoch.load(memory_order_relaxed)}};
+}
+
+void FrameTracer::append(const Event& event) noexcept
+{
+    ThreadBuffer* buffer;
+
+    try
+    {
+        buffer = threadBuffer();
+    }
+    catch(const bad_alloc&)
+    {
+        return;
+    }
+
+    const auto generation = m_generation.load(memory_order_acquire);
+
+    if (buffer->generation.load(memory_order_relaxed) != generation)
+    {
+        // Once per thread and capture: an export reads the events of the
+        // buffer under the same lock, they must not be rewritten meanwhile
+        lock_guard<mutex> lock{m_buffersMutex};
+
+        buffer->size.store(0, memory_order_relaxed);
+        buffer->dropped.store(0, memory_order_relaxed);
+        buffer->generation.store(generation, memory_order_release);
+    }
+
+    const auto size = buffer->size.load(memory_order_relaxed);
+
+    if (size == ThreadBuffer::capacity)
+    {
+        buffer->dropped.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+
+    buffer->events[size] = event;
+    buffer->size.store(size + 1, memory_order_release);
+}
+
+void FrameTracer::exportJson(ostream& os) const
+{
+    // The epoch is stored before the generation is released by start()
+    const auto generation = m_generation.load(memory_order_acquire);
+    const auto epoch = this->epoch();
+    const auto microseconds = [epoch](Clock::time_point t) {
+        return chrono::duration<double, micro>(t - epoch).count();
+    };
+
+    os << fixed << setprecision(3) << "{\"traceEvents\":[";
+
+    const char* separator = "\n";
+    lock_guard<mutex> lock{m_buffersMutex};
+
+    // A buffer of this generation is only appended to while the lock is
+    // held, past the size read here
+    for (const auto& buffer : m_buffers)
+    {
+        if (buffer->generation.load(memory_order_acquire) != generation)
+            continue;
+
+        const auto size = buffer->size.load(memory_order_acquire);
+        const auto tid = buffer->threadId;
+
+        os << separator << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+           << ",\"args\":{\"name\":\"thread " << tid << "\"}}";
+        separator = ",\n";
+
+        for (size_t i = 0; i < size; ++i)
+        {
+            const auto& event = buffer->events[i];
+
+            os << separator << "{\"name\":\"" << event.name << "\",\"ph\":\"" << event.phase
+               << "\",\"ts\":" << microseconds(event.begin);
+
+            if (event.phase == 'X')
+                os << ",\"dur\":" << microseconds(event.end) - microseconds(event.begin);
+            else
+                os << ",\"s\":\"t\"";
+
+            os << ",\"pid\":1,\"tid\":" << tid << ",\"args\":{\"value\":" << event.arg << "}}";
+        }
+
+        const auto dropped = buffer->dropped.load(memory_order_relaxed);
+
+        if (dropped > 0)
+            os << separator << "{\"name\":\"trace buffer full\",\"ph\":\"i\",\"s\":\"t\",\"ts\":"
+               << microseconds(buffer->events[size - 1].end)
+               << ",\"pid\":1,\"tid\":" << tid << ",\"args\":{\"dropped\":" << dropped << "}}";
+    }
+
+    os << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
@@ -0,0 +1,131 @@
+// Copyright (c) 2017 Elvis Dukaj
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "latencygovernor.h"
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+struct DegradationLevel {
+    int pyramidLevel;
+    bool trackingOnly;
+    int subPixIterations;
+    int maxCandidates;
+    int frameSkip;
+};
+
+// From the full pipeline down to a coarse tracker that runs every third frame
+const DegradationLevel degradationLevels[LatencyGovernor::maxLevel + 1] = {
+    {0, false, 30, 64, 0},
+    {0, false, 10, 16, 0},
+    {0, true,  10, 16, 0},
+    {1, true,   5,  8, 0},
+    {1, true,   5,  8, 1},
+    {2, true,   0,  4, 2},
+};
+
+// Smoothing factor of the detection time moving average
+const double averageWeight = 0.125;
+
+// Frames to wait after a change before degrading or recovering further
+const int degradeCooldown = 4;
+const int recoverCooldown = 30;
+
+}
+
+LatencyGovernor::LatencyGovernor()
+    : m_budget{0}
+    , m_average{0.0}
+    , m_level{0}
+    , m_framesAtLevel{0}
+    , m_skipped{0}
+{
+}
+
+void LatencyGovernor::setBudget(chrono::microseconds budget) noexcept
+{
+    m_budget = budget;
+}
+
+bool LatencyGovernor::update(chrono::microseconds elapsed) noexcept
+{
+    if (m_budget.count() <= 0)
+        return setLevel(0);
+
+    const auto budget = static_cast<double>(m_budget.count());
+    const auto sample = static_cast<double>(elapsed.count());
+
+    m_average += (sample - m_average) * averageWeight;
+    ++m_framesAtLevel;
+
+    // A single frame far beyond the budget is enough to react, otherwise
+    // wait for the average so that isolated hiccups are tolerated
+    if ((m_average > budget || sample > 2.0 * budget) && m_framesAtLevel >= degradeCooldown)
+        return setLevel(m_level + 1);
+
+    if (m_average < 0.6 * budget && m_framesAtLevel >= recoverCooldown)
+        return setLevel(m_level - 1);
+
+    return false;
+}
+
+bool LatencyGovernor::shouldSkip() noexcept
+{
+    if (m_skipped < degradationLevels[m_level].frameSkip)
+    {
+        ++m_skipped;
+        return true;
+    }
+
+    m_skipped = 0;
+    return false;
+}
+
+DetectionEffort LatencyGovernor::effort() const noexcept
+{
+    const auto& level = degradationLevels[m_level];
+
+    DetectionEffort effort;
+    effort.pyramidLevel = level.pyramidLevel;
+    effort.trackingOnly = level.trackingOnly;
+    effort.subPixIterations = level.subPixIterations;
+    effort.maxCandidates = level.maxCandidates;
+
+    return effort;
+}
+
+bool LatencyGovernor::setLevel(int level) noexcept
+{
+    level = std::min(std::max(level, 0), static_cast<int>(maxLevel));
+
+    if (level == m_level)
+        return false;
+
+    m_level = level;
+    m_framesAtLevel = 0;
+    m_skipped = 0;
+
+    return true;
+}
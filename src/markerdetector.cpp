@@ -24,6 +24,7 @@
 #include "markerdetector.h"
 #include <opencv2/calib3d.hpp>
 #include <opencv2/imgproc.hpp>
+#include <algorithm>
 #include <iostream>
 
 using namespace cv;
@@ -46,15 +47,41 @@ float perimeter(const std::vector<Point2f>& a)
     return sum;
 }
 
-vector<Point2f> projectPoints(const vector<Point3f>& objectPoints, const Mat& rvec, const Mat& tvec, const Mat& cameraMatrix, const Mat& distCoeffs)
+// rect of the full resolution image in an image scaled by scale, rounded outwards
+Rect scaleRect(const Rect& rect, float scale)
 {
-    vector<Point2f> points;
-    cv::projectPoints(objectPoints, rvec, tvec, cameraMatrix, distCoeffs, points);
-    return points;
+    if (rect.area() == 0)
+        return Rect{};
+
+    return Rect{
+        static_cast<int>(rect.x * scale), static_cast<int>(rect.y * scale),
+        static_cast<int>(rect.width * scale) + 1, static_cast<int>(rect.height * scale) + 1
+    };
+}
+
+DetectorScratch::DetectorScratch()
+    : m_markers{}
+    , m_changeDetection{false}
+    , m_firstDetected{0}
+    , m_framesSinceFullSearch{0}
+{
+}
+
+void DetectorScratch::reset() noexcept
+{
+    m_markers.clear();
+    m_cornerRefiner.reset();
+    m_changeDetector.reset();
+    m_firstDetected = 0;
+    m_framesSinceFullSearch = 0;
 }
 
 MarksDetector::MarksDetector()
-    : m_markerSize{240, 240}
+    : m_id{0}
+    , m_backend{DetectorBackend::available().front()}
+    , m_changeDetection{false}
+    , m_markerSize{DefaultMarkerLayout::imageSize, DefaultMarkerLayout::imageSize}
+    , m_stats{make_shared<DetectorStats>()}
 {
     m_markerCorners2d.push_back(Point2f{0.0f,0.0f});
     m_markerCorners2d.push_back(Point2f{static_cast<float>(m_markerSize.width),0.0f});
@@ -73,74 +100,339 @@ MarksDetector::MarksDetector()
     }
 }
 
+MarksDetector::MarksDetector(const MarksDetector& other)
+    : m_id{other.m_id}
+    , m_regionsOfInterest{other.m_regionsOfInterest}
+    , m_backend{other.m_backend}
+    , m_changeDetection{other.m_changeDetection}
+    , m_markerSize{other.m_markerSize}
+    , m_markerCorners2d{other.m_markerCorners2d}
+    , m_distortion{other.m_distortion}
+    , m_cameraMatrix{other.m_cameraMatrix}
+    , m_stats{other.m_stats}
+{
+    // The calibration is never written to, sharing its data is safe
+}
+
+const MarkerResults& MarksDetector::detect(const Mat& grayscale, DetectorScratch& scratch) const
+{
+    StageTimer frameTimer{*m_stats, DetectorStats::Stage::Frame};
+    m_stats->add(DetectorStats::Counter::Frames);
+
+    // Markers kept from frames searched under other regions of interest may
+    // lie outside the new ones, start over with a whole frame search
+    if (scratch.m_regionsOfInterest != m_regionsOfInterest)
+        scratch.reset();
+
+    if (scratch.m_changeDetection != m_changeDetection)
+    {
+        scratch.m_changeDetection = m_changeDetection;
+        scratch.m_changeDetector.reset();
+    }
+
+    // A still scene keeps the markers of the previous frame
+    if (m_changeDetection && !scratch.m_changeDetector.update(grayscale))
+    {
+        m_stats->add(DetectorStats::Counter::UnchangedFrames);
+        return scratch.m_markers;
+    }
+
+    if (!scratch.m_backend || m_backend != scratch.m_backend->name())
+        scratch.m_backend = DetectorBackend::create(m_backend);
+
+    scratch.m_quads.clear();
+    scratch.m_possibleContours.clear();
+
+    {
+        StageTimer timer{*m_stats, DetectorStats::Stage::Binarize};
+        buildPyramid(grayscale, scratch);
+        planRegions(scratch);
+        restrictRegionsToChanges(scratch);
+        keepUnchangedMarkers(scratch);
+
+        scratch.m_backend->binarize(scratch.m_searchImage, scratch.m_regions);
+    }
+    {
+        StageTimer timer{*m_stats, DetectorStats::Stage::Contours};
+        scratch.m_backend->findQuads(minSquaredSideLength(scratch.m_effort), scratch.m_quads, *m_stats);
+    }
+    {
+        StageTimer timer{*m_stats, DetectorStats::Stage::Candidates};
+        filterCandidates(scratch);
+    }
+    {
+        StageTimer timer{*m_stats, DetectorStats::Stage::Recognize};
+        recognizeCandidates(scratch);
+    }
+    {
+        StageTimer timer{*m_stats, DetectorStats::Stage::Refine};
+        refineCorners(scratch);
+    }
+    {
+        StageTimer timer{*m_stats, DetectorStats::Stage::Pose};
+        estimatePose(scratch);
+    }
+
+    return scratch.m_markers;
+}
+
 void MarksDetector::processFame(Mat& grayscale)
 {
-    m_contours.clear();
-    m_possibleContours.clear();
-    m_markers.clear();
+    detect(grayscale, m_scratch);
+}
 
-    m_minCountournSize = grayscale.cols / 5;
+const MarkerResults& MarksDetector::markers() const noexcept
+{
+    return m_scratch.markers();
+}
+
+void MarksDetector::setBackend(const std::string& name)
+{
+    const auto names = DetectorBackend::available();
+
+    if (find(begin(names), end(names), name) == end(names))
+        throw std::runtime_error{"unknown detector back-end " + name};
 
-    binarize(grayscale);
-    findContours();
-    findCandidates();
-    recognizeCandidates();
-    estimatePose();
+    m_backend = name;
 }
 
-const std::vector<Marker> &MarksDetector::markers() const noexcept
+void MarksDetector::setStats(const std::shared_ptr<DetectorStats>& stats)
 {
-    return m_markers;
+    m_stats = stats ? stats : make_shared<DetectorStats>();
 }
 
-void MarksDetector::binarize(const Mat& grayscale)
+void MarksDetector::buildPyramid(const Mat& grayscale, DetectorScratch& scratch) const
 {
-    m_grayscale = grayscale;
-    threshold(m_grayscale, m_binarized, 127, 255.0, THRESH_BINARY | THRESH_OTSU);
+    scratch.m_grayscale = grayscale;
+    scratch.m_pyramid.resize(static_cast<size_t>(scratch.m_effort.pyramidLevel));
+
+    const Mat* level = &scratch.m_grayscale;
+
+    for (auto& downscaled : scratch.m_pyramid)
+    {
+        pyrDown(*level, downscaled);
+        level = &downscaled;
+    }
+
+    scratch.m_searchImage = *level;
 }
 
-void MarksDetector::findContours()
+void MarksDetector::planRegions(DetectorScratch& scratch) const
 {
-    cv::findContours(m_binarized, m_contours, RETR_LIST, CHAIN_APPROX_NONE);
+    // Without tracking, or when nothing was tracked, search the whole image.
+    // While tracking a full search is still forced from time to time so that
+    // markers entering the scene are eventually acquired.
+    const int fullSearchInterval = 15;
+
+    scratch.m_regions.clear();
+    updateRegionsOfInterest(scratch.m_grayscale.size(), scratch);
+
+    if (!scratch.m_effort.trackingOnly || scratch.m_markers.empty() || ++scratch.m_framesSinceFullSearch >= fullSearchInterval)
+    {
+        scratch.m_framesSinceFullSearch = 0;
+        addSearchRegion(Rect{Point{0, 0}, scratch.m_grayscale.size()}, scratch);
+        return;
+    }
+
+    for (int i = 0; i < scratch.m_markers.size(); ++i)
+    {
+        auto box = boundingRect(scratch.m_markers.cornersOf(i));
+
+        // Leave room for the marker to move by half its size
+        box -= Point{box.width / 2, box.height / 2};
+        box += Size{box.width, box.height};
+
+        addSearchRegion(box, scratch);
+    }
 }
 
-void MarksDetector::findCandidates()
+void MarksDetector::setRegionsOfInterest(const vector<vector<Point2f>>& regions)
 {
-    vector<Point2f> approxCurve;
-    vector<vector<Point2f>> possibleMarkerPoints;
+    m_regionsOfInterest = regions;
+}
 
-    // For each contour, analyze if it is a parallelepiped likely to be the marker
-    for (size_t i=0; i < m_contours.size(); i++)
+void MarksDetector::updateRegionsOfInterest(Size frameSize, DetectorScratch& scratch) const
+{
+    if (scratch.m_regionsOfInterestSize == frameSize && scratch.m_regionsOfInterest == m_regionsOfInterest)
+        return;
+
+    scratch.m_regionsOfInterest = m_regionsOfInterest;
+    scratch.m_regionsOfInterestSize = frameSize;
+    scratch.m_regionOfInterestPolygons.clear();
+    scratch.m_regionOfInterestRects.clear();
+
+    const Rect frameRect{Point{0, 0}, frameSize};
+
+    for (const auto& region : m_regionsOfInterest)
     {
-        // Approximate to a polygon
-        double eps = m_contours[i].size() * 0.05;
-        approxPolyDP(m_contours[i], approxCurve, eps, true);
+        vector<Point2f> polygon;
 
-        // We interested only in polygons that contains only four points
-        if (approxCurve.size() != 4)
-            continue;
+        for (const auto& p : region)
+            polygon.emplace_back(p.x * frameSize.width, p.y * frameSize.height);
 
-        // And they have to be convex
-        if (!isContourConvex(approxCurve))
+        const auto rect = polygon.size() >= 3 ? boundingRect(polygon) & frameRect : Rect{};
+
+        if (rect.area() == 0)
             continue;
 
-        // Ensure that the distance between consecutive points is large enough
-        float minDist = std::numeric_limits<float>::max();
+        scratch.m_regionOfInterestPolygons.push_back(std::move(polygon));
+        scratch.m_regionOfInterestRects.push_back(rect);
+    }
+}
+
+void MarksDetector::addSearchRegion(const Rect& rect, DetectorScratch& scratch) const
+{
+    // rect is in the full resolution image, regions in the search image
+    const float scale = 1.0f / static_cast<float>(1 << scratch.m_effort.pyramidLevel);
+    const Rect searchRect{Point{0, 0}, scratch.m_searchImage.size()};
+
+    if (m_regionsOfInterest.empty())
+    {
+        addRegion(scaleRect(rect, scale) & searchRect, scratch);
+        return;
+    }
+
+    // Unless they overlap, regions of interest are kept apart so that each
+    // one gets its own threshold
+    for (const auto& regionOfInterest : scratch.m_regionOfInterestRects)
+        addRegion(scaleRect(rect & regionOfInterest, scale) & searchRect, scratch);
+}
+
+bool MarksDetector::insideRegionsOfInterest(const vector<Point2f>& points, const DetectorScratch& scratch) const
+{
+    if (m_regionsOfInterest.empty())
+        return true;
+
+    return any_of(begin(scratch.m_regionOfInterestPolygons), end(scratch.m_regionOfInterestPolygons), [&](const vector<Point2f>& polygon)
+    {
+        return all_of(begin(points), end(points), [&](const Point2f& p) { return pointPolygonTest(polygon, p, false) >= 0; });
+    });
+}
+
+void MarksDetector::addRegion(const Rect& region, DetectorScratch& scratch) const
+{
+    if (region.area() == 0)
+        return;
+
+    // Merge overlapping regions so that no contour is traced twice. The
+    // regions never overlap each other, but the merged one may overlap
+    // several of them once grown.
+    Rect merged = region;
+
+    for (;;)
+    {
+        auto overlapping = find_if(begin(scratch.m_regions), end(scratch.m_regions),
+                                   [&](const Rect& r) { return (r & merged).area() > 0; });
+
+        if (overlapping == end(scratch.m_regions))
+            break;
+
+        merged |= *overlapping;
+        scratch.m_regions.erase(overlapping);
+    }
+
+    scratch.m_regions.push_back(merged);
+}
+
+void MarksDetector::restrictRegionsToChanges(DetectorScratch& scratch) const
+{
+    if (!m_changeDetection)
+        return;
+
+    // A marker partly covered by a change is searched as a whole, with some
+    // margin, until no changed region grows anymore
+    scratch.m_changedRegions = scratch.m_changeDetector.changedRegions();
+
+    for (bool grown = true; grown; )
+    {
+        grown = false;
 
-        for (int i = 0; i < 4; i++)
+        for (auto& changed : scratch.m_changedRegions)
         {
-            Point side = approxCurve[i] - approxCurve[(i+1)%4];
-            float squaredSideLength = static_cast<float>(side.dot(side));
-            minDist = std::min(minDist, squaredSideLength);
+            for (int i = 0; i < scratch.m_markers.size(); ++i)
+            {
+                auto box = boundingRect(scratch.m_markers.cornersOf(i));
+
+                if ((box & changed).area() == 0)
+                    continue;
+
+                box -= Point{box.width / 4, box.height / 4};
+                box += Size{box.width / 2, box.height / 2};
+
+                if ((changed | box) != changed)
+                {
+                    changed |= box;
+                    grown = true;
+                }
+            }
         }
+    }
 
-        // Check that distance is not very small
-        if (minDist < 500)
-            continue;
+    const float scale = 1.0f / static_cast<float>(1 << scratch.m_effort.pyramidLevel);
+    const Rect searchRect{Point{0, 0}, scratch.m_searchImage.size()};
+
+    swap(scratch.m_plannedRegions, scratch.m_regions);
+    scratch.m_regions.clear();
+
+    for (const auto& region : scratch.m_plannedRegions)
+        for (const auto& changed : scratch.m_changedRegions)
+            addRegion(region & scaleRect(changed, scale) & searchRect, scratch);
+}
+
+void MarksDetector::keepUnchangedMarkers(DetectorScratch& scratch) const
+{
+    scratch.m_firstDetected = 0;
+
+    if (!m_changeDetection)
+    {
+        scratch.m_markers.clear();
+        return;
+    }
+
+    // Markers away from any change are kept, the others are detected again
+    for (int i = 0; i < scratch.m_markers.size(); ++i)
+    {
+        const auto box = boundingRect(scratch.m_markers.cornersOf(i));
+
+        const bool changed = any_of(begin(scratch.m_changedRegions), end(scratch.m_changedRegions),
+                                    [&](const Rect& r) { return (r & box).area() > 0; });
+
+        if (!changed)
+            scratch.m_markers.move(i, scratch.m_firstDetected++);
+    }
+
+    scratch.m_markers.count = scratch.m_firstDetected;
+}
 
-        // All tests are passed. Save marker candidate:
-        vector<Point2f> markerPoints = approxCurve;
+float MarksDetector::minSquaredSideLength(const DetectionEffort& effort) const noexcept
+{
+    // Side lengths are measured in the downscaled search image
+    return 500.0f / static_cast<float>(1 << (2 * effort.pyramidLevel));
+}
 
+void MarksDetector::filterCandidates(DetectorScratch& scratch) const
+{
+    if (!m_regionsOfInterest.empty())
+    {
+        // Corners are tested in the full resolution image
+        const float scale = static_cast<float>(1 << scratch.m_effort.pyramidLevel);
+        vector<Point2f> corners(4);
+
+        const auto outside = [&](const vector<Point2f>& points)
+        {
+            for (size_t c = 0; c < points.size(); ++c)
+                corners[c] = (points[c] + Point2f{0.5f, 0.5f}) * scale - Point2f{0.5f, 0.5f};
+
+            return !insideRegionsOfInterest(corners, scratch);
+        };
+
+        const auto quads = scratch.m_quads.size();
+        scratch.m_quads.erase(remove_if(begin(scratch.m_quads), end(scratch.m_quads), outside), end(scratch.m_quads));
+        m_stats->add(DetectorStats::Counter::RejectedOutsideRegion, quads - scratch.m_quads.size());
+    }
+
+    for (auto& markerPoints : scratch.m_quads)
+    {
         // Sort the points in anti-clockwise order
         // Trace a line between the first and second point.
         // If the third point is at the right side, then the points are anti-clockwise
@@ -151,20 +443,18 @@ void MarksDetector::findCandidates()
 
         if (o < 0.0)		 // if the third point is in the left side, then sort in anti-clockwise order
             std::swap(markerPoints[1], markerPoints[3]);
-
-        possibleMarkerPoints.emplace_back(markerPoints);
     }
 
     // calculate the average distance of each corner to the nearest corner of the other marker candidate
     std::vector< std::pair<int,int> > tooNearCandidates;
-    for (int i=0;i<possibleMarkerPoints.size();i++)
+    for (int i=0;i<scratch.m_quads.size();i++)
     {
-        const auto& points1 = possibleMarkerPoints[i];
+        const auto& points1 = scratch.m_quads[i];
 
         //calculate the average distance of each corner to the nearest corner of the other marker candidate
-        for (int j=i+1;j<possibleMarkerPoints.size();j++)
+        for (int j=i+1;j<scratch.m_quads.size();j++)
         {
-            const auto& points2 = possibleMarkerPoints[j];
+            const auto& points2 = scratch.m_quads[j];
 
             float distSquared = 0;
 
@@ -182,12 +472,12 @@ void MarksDetector::findCandidates()
     }
 
     // Mark for removal the element of the pair with smaller perimeter
-    std::vector<bool> removalMask (possibleMarkerPoints.size(), false);
+    std::vector<bool> removalMask (scratch.m_quads.size(), false);
 
     for (size_t i = 0; i < tooNearCandidates.size(); i++)
     {
-        float p1 = perimeter(possibleMarkerPoints[tooNearCandidates[i].first ]);
-        float p2 = perimeter(possibleMarkerPoints[tooNearCandidates[i].second]);
+        float p1 = perimeter(scratch.m_quads[tooNearCandidates[i].first ]);
+        float p2 = perimeter(scratch.m_quads[tooNearCandidates[i].second]);
 
         size_t removalIndex;
         if (p1 > p2)
@@ -198,67 +488,119 @@ void MarksDetector::findCandidates()
         removalMask[removalIndex] = true;
     }
 
-    for (size_t i = 0; i < possibleMarkerPoints.size(); i++)
+    for (size_t i = 0; i < scratch.m_quads.size(); i++)
         if (!removalMask[i])
-            m_possibleContours.push_back(possibleMarkerPoints[i]);
+            scratch.m_possibleContours.push_back(scratch.m_quads[i]);
+
+    m_stats->add(DetectorStats::Counter::RejectedTooNear, scratch.m_quads.size() - scratch.m_possibleContours.size());
+
+    // Under load only the largest candidates are worth recognizing, and no
+    // more than the results can hold are ever recognized
+    const auto maxCandidates = static_cast<size_t>(std::min(std::max(scratch.m_effort.maxCandidates, 0), MarkerResults::capacity));
+
+    if (scratch.m_possibleContours.size() > maxCandidates)
+    {
+        m_stats->add(DetectorStats::Counter::RejectedOverCap, scratch.m_possibleContours.size() - maxCandidates);
+
+        std::partial_sort(begin(scratch.m_possibleContours), begin(scratch.m_possibleContours) + maxCandidates, end(scratch.m_possibleContours),
+                          [](const vector<Point2f>& a, const vector<Point2f>& b) { return perimeter(a) > perimeter(b); });
+        scratch.m_possibleContours.resize(maxCandidates);
+    }
 }
 
-void MarksDetector::recognizeCandidates()
+void MarksDetector::recognizeCandidates(DetectorScratch& scratch) const
 {
-    for(auto& points: m_possibleContours)
-    {
-        Mat canonicalMarkerImage;
+    const Mat binarized = scratch.m_backend->binarized();
 
+    for(auto& points: scratch.m_possibleContours)
+    {
         // Find the perspective transformation that brings current marker to rectangular form
         Mat markerTransform = getPerspectiveTransform(points, m_markerCorners2d);
 
-        // Transform image to get a canonical marker image
-        warpPerspective(m_binarized, canonicalMarkerImage,  markerTransform, m_markerSize);
+        // Transform image to get a canonical marker image, packed to one bit
+        // per pixel: every non zero pixel of the warped image counts as white.
+        // Back-ends without a binarized image have the canonical image warped
+        // from the grayscale and thresholded on its own.
+        if (binarized.empty())
+        {
+            warpPerspective(scratch.m_searchImage, scratch.m_canonicalMarkerImage,  markerTransform, m_markerSize);
+            scratch.m_packedMarkerImage.threshold(scratch.m_canonicalMarkerImage, otsuThreshold(scratch.m_canonicalMarkerImage));
+        }
+        else
+        {
+            warpPerspective(binarized, scratch.m_canonicalMarkerImage,  markerTransform, m_markerSize);
+            scratch.m_packedMarkerImage.threshold(scratch.m_canonicalMarkerImage, 0);
+        }
 
-        Marker m(canonicalMarkerImage, points);
+        // Bring the corners back to the full resolution image
+        const float scale = static_cast<float>(1 << scratch.m_effort.pyramidLevel);
 
-        if (!m.isValid())
-            continue;
+        for (auto& p : points)
+            p = (p + Point2f{0.5f, 0.5f}) * scale - Point2f{0.5f, 0.5f};
 
-        TermCriteria termCriteria = TermCriteria{TermCriteria::MAX_ITER | TermCriteria::EPS, 30, 0.01};
-        cornerSubPix(m_grayscale, points, Size{5, 5}, Size{-1, -1}, termCriteria);
+        uint64_t id = 0;
+        float confidence = 0.0f;
+        int orientation = 0;
 
-        m.precisePoints(points);
-        m_markers.push_back(m);
+        switch (MarkerCodec<DefaultMarkerLayout>::decode(scratch.m_packedMarkerImage, id, confidence, orientation)) {
+        case MarkerStatus::Valid:
+            // Start from the top left corner of the marker whatever its
+            // rotation, overlay and pose follow the marker
+            std::rotate(points.begin(), points.begin() + orientation, points.end());
+            scratch.m_markers.add(id, points, confidence);
+            break;
+
+        case MarkerStatus::BadBorder:
+            m_stats->add(DetectorStats::Counter::RejectedBorder);
+            break;
+
+        case MarkerStatus::BadOrientation:
+            m_stats->add(DetectorStats::Counter::RejectedOrientation);
+            break;
+
+        case MarkerStatus::BadCrc:
+            m_stats->add(DetectorStats::Counter::CrcFailures);
+            break;
+        }
     }
+
+    m_stats->add(DetectorStats::Counter::ValidMarkers, scratch.m_markers.size() - scratch.m_firstDetected);
 }
 
-void MarksDetector::estimatePose()
+void MarksDetector::refineCorners(DetectorScratch& scratch) const
 {
-    for(Marker& m : m_markers)
-    {
-        vector<Point3f> objectPoints = {Point3f(-1, -1, 0), Point3f(-1, 1, 0), Point3f(1, 1, 0), Point3f(1, -1, 0)};
-
-        Mat objectPointsMat(objectPoints);
-        Mat rvec, tvec;
-        solvePnP(objectPointsMat, m.points(), m_cameraMatrix, m_distortion, rvec, tvec);
+    scratch.m_cornerRefiner.refine(scratch.m_grayscale, scratch.m_markers, scratch.m_effort.subPixIterations, scratch.m_firstDetected);
+}
 
-        vector<vector<Point3f>> lineIn3D =
-        {
-            {{-1.0f, -1.0f, 0.0f}, {-1.0f, -1.0f, 2.0f}},
-            {{-1.0f,  1.0f, 0.0f}, {-1.0f,  1.0f, 2.0f}},
-            {{ 1.0f, -1.0f, 0.0f}, { 1.0f, -1.0f, 2.0f}},
-            {{ 1.0f,  1.0f, 0.0f}, { 1.0f,  1.0f, 2.0f}},
-            {{-1.0f,  1.0f, 2.0f}, { 1.0f,  1.0f, 2.0f}},
-            {{-1.0f, -1.0f, 2.0f}, { 1.0f, -1.0f, 2.0f}},
-            {{-1.0f,  1.0f, 2.0f}, {-1.0f, -1.0f, 2.0f}},
-            {{ 1.0f,  1.0f, 2.0f}, { 1.0f, -1.0f, 2.0f}}
-        };
+void MarksDetector::estimatePose(DetectorScratch& scratch) const
+{
+    static const vector<Point3f> objectPoints = {Point3f(-1, -1, 0), Point3f(-1, 1, 0), Point3f(1, 1, 0), Point3f(1, -1, 0)};
 
-        vector<vector<Point2f>> lineIn2D;
-        lineIn2D.reserve(lineIn3D.size());
+    // End points of the cube edges, two by two
+    static const vector<Point3f> cubePoints =
+    {
+        {-1.0f, -1.0f, 0.0f}, {-1.0f, -1.0f, 2.0f},
+        {-1.0f,  1.0f, 0.0f}, {-1.0f,  1.0f, 2.0f},
+        { 1.0f, -1.0f, 0.0f}, { 1.0f, -1.0f, 2.0f},
+        { 1.0f,  1.0f, 0.0f}, { 1.0f,  1.0f, 2.0f},
+        {-1.0f,  1.0f, 2.0f}, { 1.0f,  1.0f, 2.0f},
+        {-1.0f, -1.0f, 2.0f}, { 1.0f, -1.0f, 2.0f},
+        {-1.0f,  1.0f, 2.0f}, {-1.0f, -1.0f, 2.0f},
+        { 1.0f,  1.0f, 2.0f}, { 1.0f, -1.0f, 2.0f}
+    };
+
+    for (int i = scratch.m_firstDetected; i < scratch.m_markers.size(); ++i)
+    {
+        solvePnP(objectPoints, scratch.m_markers.cornersOf(i), m_cameraMatrix, m_distortion, scratch.m_rvec, scratch.m_tvec);
 
-        std::transform(begin(lineIn3D), end(lineIn3D), back_inserter(lineIn2D),
-                       [&,this](const vector<Point3f>& points3D)
+        for (int k = 0; k < 3; ++k)
         {
-            return projectPoints(points3D, rvec, tvec, m_cameraMatrix, m_distortion);
-        });
+            scratch.m_markers.rotations[i][k] = static_cast<float>(scratch.m_rvec.at<double>(k));
+            scratch.m_markers.translations[i][k] = static_cast<float>(scratch.m_tvec.at<double>(k));
+        }
 
-        m.setCube(lineIn2D);
+        // Projected straight into the results
+        Mat cube = scratch.m_markers.cubeOf(i);
+        cv::projectPoints(cubePoints, scratch.m_rvec, scratch.m_tvec, m_cameraMatrix, m_distortion, cube);
     }
 }
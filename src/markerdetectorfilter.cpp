@@ -22,27 +22,352 @@
 // OTHER DEALINGS IN THE SOFTWARE.
 
 #include "markerdetectorfilter.h"
-#include <opencv2/highgui.hpp>
+#include <QDateTime>
+#include <QPointF>
+#include <QRectF>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
 #include <iostream>
 
 using namespace std;
 using namespace string_literals;
 
+MarkerDetectorFilter::MarkerDetectorFilter(QObject* parent)
+    : QAbstractVideoFilter{parent}
+    , m_stats{make_shared<DetectorStats>()}
+    , m_latencyBudget{0}
+    , m_degradationLevel{0}
+    , m_backendIndex{0}
+    , m_changeDetection{false}
+    , m_overlayDirectoryVersion{0}
+{
+    connect(&m_statisticsTimer, &QTimer::timeout, this, &MarkerDetectorFilter::publishStatistics);
+    m_statisticsTimer.start(1000);
+}
+
 QVideoFilterRunnable* MarkerDetectorFilter::createFilterRunnable()
 {
     return new MarkerDetectorFilterRunnable(this);
 }
 
+void MarkerDetectorFilter::setRecordFile(const QString& recordFile)
+{
+    if (m_recordFile == recordFile)
+        return;
+
+    m_recordFile = recordFile;
+    emit recordFileChanged();
+}
+
+void MarkerDetectorFilter::setLatencyBudget(int latencyBudget)
+{
+    if (m_latencyBudget == latencyBudget)
+        return;
+
+    m_latencyBudget = latencyBudget;
+    emit latencyBudgetChanged();
+}
+
+QString MarkerDetectorFilter::backend() const
+{
+    return QString::fromStdString(DetectorBackend::available()[m_backendIndex]);
+}
+
+void MarkerDetectorFilter::setBackend(const QString& backend)
+{
+    const auto names = DetectorBackend::available();
+    const auto found = find(begin(names), end(names), backend.toStdString());
+
+    if (found == end(names))
+    {
+        cerr << "Unknown detector back-end " << backend.toStdString() << endl;
+        return;
+    }
+
+    const auto index = static_cast<int>(found - begin(names));
+
+    if (m_backendIndex.exchange(index) == index)
+        return;
+
+    publishDetector();
+    emit backendChanged();
+}
+
+QStringList MarkerDetectorFilter::availableBackends() const
+{
+    QStringList names;
+
+    for (const auto& name : DetectorBackend::available())
+        names << QString::fromStdString(name);
+
+    return names;
+}
+
+void MarkerDetectorFilter::setChangeDetection(bool changeDetection)
+{
+    if (m_changeDetection == changeDetection)
+        return;
+
+    m_changeDetection = changeDetection;
+    publishDetector();
+    emit changeDetectionChanged();
+}
+
+void MarkerDetectorFilter::setRegions(const QVariantList& regions)
+{
+    if (m_regions == regions)
+        return;
+
+    const auto toPoint = [](const QVariant& value)
+    {
+        if (value.type() == QVariant::Map)
+        {
+            const auto map = value.toMap();
+            return cv::Point2f{map["x"].toFloat(), map["y"].toFloat()};
+        }
+
+        const auto point = value.toPointF();
+        return cv::Point2f{static_cast<float>(point.x()), static_cast<float>(point.y())};
+    };
+
+    vector<vector<cv::Point2f>> polygons;
+
+    for (int i = 0; i < regions.size(); ++i)
+    {
+        const auto& region = regions[i];
+        vector<cv::Point2f> polygon;
+
+        if (region.type() == QVariant::List)
+        {
+            for (const auto& point : region.toList())
+                polygon.push_back(toPoint(point));
+        }
+        else
+        {
+            QRectF rect = region.toRectF();
+
+            if (region.type() == QVariant::Map)
+            {
+                const auto map = region.toMap();
+                rect = QRectF{map["x"].toReal(), map["y"].toReal(), map["width"].toReal(), map["height"].toReal()};
+            }
+
+            if (!rect.isEmpty())
+                polygon = {
+                    {static_cast<float>(rect.left()), static_cast<float>(rect.top())},
+                    {static_cast<float>(rect.right()), static_cast<float>(rect.top())},
+                    {static_cast<float>(rect.right()), static_cast<float>(rect.bottom())},
+                    {static_cast<float>(rect.left()), static_cast<float>(rect.bottom())}
+                };
+        }
+
+        if (polygon.size() < 3)
+        {
+            cerr << "Ignoring region of interest " << i << ": not a rect nor a polygon" << endl;
+            continue;
+        }
+
+        polygons.push_back(polygon);
+    }
+
+    {
+        lock_guard<mutex> lock{m_detectorMutex};
+        m_regionPolygons = std::move(polygons);
+    }
+
+    publishDetector();
+
+    m_regions = regions;
+    emit regionsChanged();
+}
+
+QString MarkerDetectorFilter::overlayDirectory() const
+{
+    lock_guard<mutex> lock{m_overlayDirectoryMutex};
+    return m_overlayDirectory;
+}
+
+void MarkerDetectorFilter::setOverlayDirectory(const QString& overlayDirectory)
+{
+    {
+        lock_guard<mutex> lock{m_overlayDirectoryMutex};
+
+        if (m_overlayDirectory == overlayDirectory)
+            return;
+
+        m_overlayDirectory = overlayDirectory;
+        ++m_overlayDirectoryVersion;
+    }
+
+    emit overlayDirectoryChanged();
+}
+
+QString MarkerDetectorFilter::overlayDirectory(int& version) const
+{
+    lock_guard<mutex> lock{m_overlayDirectoryMutex};
+    version = m_overlayDirectoryVersion;
+    return m_overlayDirectory;
+}
+
+QVariantMap MarkerDetectorFilter::statistics() const
+{
+    const auto toMilliseconds = [](chrono::microseconds value) { return value.count() / 1000.0; };
+
+    QVariantMap latencies;
+
+    for (int i = 0; i < static_cast<int>(DetectorStats::Stage::Count); ++i)
+    {
+        const auto stage = static_cast<DetectorStats::Stage>(i);
+        const auto& histogram = m_stats->histogram(stage);
+
+        latencies[DetectorStats::name(stage)] = QVariantMap{
+            {"count", static_cast<qulonglong>(histogram.count())},
+            {"p50", toMilliseconds(histogram.percentile(0.5))},
+            {"p99", toMilliseconds(histogram.percentile(0.99))},
+            {"p999", toMilliseconds(histogram.percentile(0.999))},
+            {"max", toMilliseconds(histogram.max())}
+        };
+    }
+
+    QVariantMap counters;
+
+    for (int i = 0; i < static_cast<int>(DetectorStats::Counter::Count); ++i)
+    {
+        const auto counter = static_cast<DetectorStats::Counter>(i);
+        counters[DetectorStats::name(counter)] = static_cast<qulonglong>(m_stats->counter(counter));
+    }
+
+    return QVariantMap{{"latencies", latencies}, {"counters", counters}};
+}
+
+void MarkerDetectorFilter::setStatisticsInterval(int statisticsInterval)
+{
+    if (std::max(statisticsInterval, 0) == this->statisticsInterval())
+        return;
+
+    if (statisticsInterval > 0)
+        m_statisticsTimer.start(statisticsInterval);
+    else
+        m_statisticsTimer.stop();
+
+    emit statisticsIntervalChanged();
+}
+
+void MarkerDetectorFilter::setStatisticsFile(const QString& statisticsFile)
+{
+    if (m_statisticsFile == statisticsFile)
+        return;
+
+    m_statisticsFile = statisticsFile;
+    emit statisticsFileChanged();
+}
+
+void MarkerDetectorFilter::publishStatistics()
+{
+    // Snapshots are only taken here, by QML bindings reading the property or
+    // for the dump: the detector itself only bumps atomic counters
+    emit statisticsChanged();
+
+    if (m_statisticsFile.isEmpty())
+        return;
+
+    ofstream dump{m_statisticsFile.toStdString(), ios::app};
+
+    if (!dump)
+    {
+        cerr << "Unable to open " << m_statisticsFile.toStdString() << endl;
+        return;
+    }
+
+    dump << "# " << QDateTime::currentDateTime().toString(Qt::ISODate).toStdString() << '\n';
+    m_stats->dump(dump);
+    dump << '\n';
+}
+
+void MarkerDetectorFilter::setTracing(bool tracing)
+{
+    if (tracing == this->tracing())
+        return;
+
+    if (tracing)
+        FrameTracer::instance().start();
+    else
+        FrameTracer::instance().stop();
+
+    emit tracingChanged();
+}
+
+bool MarkerDetectorFilter::saveTrace(const QString& fileName) const
+{
+    ofstream trace{fileName.toStdString()};
+
+    if (!trace)
+    {
+        cerr << "Unable to open " << fileName.toStdString() << endl;
+        return false;
+    }
+
+    FrameTracer::instance().exportJson(trace);
+    return static_cast<bool>(trace);
+}
+
+shared_ptr<const MarksDetector> MarkerDetectorFilter::detector()
+{
+    lock_guard<mutex> lock{m_detectorMutex};
+
+    // Built by the first runnable, so that the calibration is read once
+    if (!m_detector)
+    {
+        auto detector = make_shared<MarksDetector>();
+        detector->setStats(m_stats);
+        applySettings(*detector);
+        m_detector = std::move(detector);
+    }
+
+    return m_detector;
+}
+
+void MarkerDetectorFilter::publishDetector()
+{
+    lock_guard<mutex> lock{m_detectorMutex};
+
+    if (!m_detector)
+        return;
+
+    // Runnables in the middle of a frame keep the detector they started with
+    auto detector = make_shared<MarksDetector>(*m_detector);
+    applySettings(*detector);
+    m_detector = std::move(detector);
+}
+
+void MarkerDetectorFilter::applySettings(MarksDetector& detector) const
+{
+    detector.setBackend(DetectorBackend::available()[m_backendIndex]);
+    detector.setChangeDetection(m_changeDetection);
+    detector.setRegionsOfInterest(m_regionPolygons);
+}
+
+void MarkerDetectorFilter::setDegradationLevel(int degradationLevel)
+{
+    if (m_degradationLevel.exchange(degradationLevel) != degradationLevel)
+        emit degradationLevelChanged();
+}
+
 MarkerDetectorFilterRunnable::MarkerDetectorFilterRunnable(MarkerDetectorFilter* filter)
 try : m_filter{filter}
+    , m_overlayDirectoryVersion{-1}
+    , m_lastRunTraced{false}
+    , m_lastStartTime{-1}
+    , m_frameInterval{0.0}
 {
-//    m_pattern = cv::imread("pattern.bmp", cv::IMREAD_COLOR);
+    // Fails early without calibration
+    filter->detector();
 
-//    if (!m_pattern.data)
-//    {
-//        cerr << "Unable to open pattern.bmp";
-//        throw runtime_error{"Unable to open pattern.bmp"};
-//    }
+    // The recording is bound to the runnable: it covers the frames seen by
+    // this video pipeline from its creation on
+    if (!filter->recordFile().isEmpty())
+        m_recorder = make_unique<FrameRecorder>(filter->recordFile());
 }
 catch(const runtime_error& err)
 {
@@ -51,6 +376,25 @@ catch(const runtime_error& err)
 }
 
 QVideoFrame MarkerDetectorFilterRunnable::run(QVideoFrame* frame, const QVideoSurfaceFormat&, QVideoFilterRunnable::RunFlags)
+{
+    const bool tracing = FrameTracer::instance().isEnabled();
+
+    if (tracing)
+        traceArrival(*frame);
+
+    QVideoFrame output;
+    {
+        TraceScope scope{"run"};
+        output = process(frame);
+    }
+
+    m_lastRunEnd = FrameTracer::Clock::now();
+    m_lastRunTraced = tracing;
+
+    return output;
+}
+
+QVideoFrame MarkerDetectorFilterRunnable::process(QVideoFrame* frame)
 {
     if (!isFrameValid(frame))
     {
@@ -67,22 +411,54 @@ QVideoFrame MarkerDetectorFilterRunnable::run(QVideoFrame* frame, const QVideoSu
     try
     {
         cv::Mat frameMat, grayscale;
-        videoFrameInGrayScaleAndColor(frame, grayscale, frameMat);
+        {
+            TraceScope scope{"convert"};
+            videoFrameInGrayScaleAndColor(frame, grayscale, frameMat);
+        }
 
-        m_marksDetector.processFame(grayscale);
+        if (m_recorder)
+        {
+            TraceScope scope{"record"};
 
+            // A failing recording, a full disk for instance, is given up
+            // once and for all, the detection goes on without it
+            try
+            {
+                m_recorder->record(grayscale);
+            }
+            catch(const exception& exc)
+            {
+                cerr << exc.what() << ", recording stopped" << endl;
+                m_recorder.reset();
+            }
+        }
+
+        detect(grayscale);
 
         string idStr;
-        if (!m_marksDetector.markers().empty())
+        const auto& markers = m_scratch.markers();
+
+        if (!markers.empty())
         {
-            for(const Marker& marker : m_marksDetector.markers())
+            TraceScope scope{"draw"};
+
+            if (m_filter->overlayDirectoryVersion() != m_overlayDirectoryVersion)
+                m_overlays.setDirectory(m_filter->overlayDirectory(m_overlayDirectoryVersion));
+
+            for (int i = 0; i < markers.size(); ++i)
             {
-                idStr += to_string(marker.id()) + " "s;
-//              marker.drawImage(frameMat, m_pattern);
-                marker.drawContours(frameMat, 3);
+                idStr += to_string(markers.ids[i]) + " "s;
+
+                const auto& overlay = m_overlays.overlay(markers.ids[i], frameMat.type());
+
+                if (overlay.image.empty())
+                    drawMarkerContours(frameMat, markers, i, 3);
+                else
+                    drawMarkerOverlay(frameMat, markers, i, overlay, m_warpedOverlay, m_warpedOverlayMask);
             }
         }
 
+        TraceScope scope{"markerFound"};
         emit m_filter->markerFound(QString::fromStdString(idStr));
     }
     catch(const exception& exc)
@@ -95,3 +471,51 @@ QVideoFrame MarkerDetectorFilterRunnable::run(QVideoFrame* frame, const QVideoSu
 
     return *frame;
 }
+
+void MarkerDetectorFilterRunnable::traceArrival(const QVideoFrame& frame)
+{
+    auto& tracer = FrameTracer::instance();
+
+    // Time spent by the pipeline between two frames, queueing included
+    if (m_lastRunTraced)
+        tracer.complete("wait", m_lastRunEnd, FrameTracer::Clock::now());
+
+    // Frames dropped upstream show up as holes in the presentation times
+    const auto startTime = frame.startTime();
+
+    if (startTime >= 0 && m_lastStartTime >= 0 && startTime > m_lastStartTime)
+    {
+        const auto interval = static_cast<double>(startTime - m_lastStartTime);
+
+        if (m_frameInterval > 0.0 && interval > 1.5 * m_frameInterval)
+            tracer.instant("dropped", static_cast<int64_t>(interval / m_frameInterval + 0.5) - 1);
+        else
+            m_frameInterval = m_frameInterval > 0.0 ? 0.9 * m_frameInterval + 0.1 * interval : interval;
+    }
+
+    m_lastStartTime = startTime;
+}
+
+void MarkerDetectorFilterRunnable::detect(cv::Mat& grayscale)
+{
+    m_governor.setBudget(chrono::milliseconds{m_filter->latencyBudget()});
+
+    // A skipped frame keeps showing the markers of the last processed one
+    if (m_governor.shouldSkip())
+    {
+        FrameTracer::instance().instant("skipped");
+        return;
+    }
+
+    const auto detector = m_filter->detector();
+
+    auto start = chrono::steady_clock::now();
+    detector->detect(grayscale, m_scratch);
+    auto elapsed = chrono::steady_clock::now() - start;
+
+    if (m_governor.update(chrono::duration_cast<chrono::microseconds>(elapsed)))
+    {
+        m_scratch.setEffort(m_governor.effort());
+        m_filter->setDegradationLevel(m_governor.level());
+    }
+}
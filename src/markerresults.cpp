@@ -0,0 +1,64 @@
+// Copyright (c) 2017 Elvis Dukaj
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "markerresults.h"
+#include <algorithm>
+
+using namespace cv;
+using namespace std;
+
+const int MarkerResults::capacity;
+const int MarkerResults::cubeLines;
+
+int MarkerResults::add(uint64_t id, const vector<Point2f>& points, float confidence) noexcept
+{
+    if (full())
+        return -1;
+
+    const int i = count++;
+
+    ids[i] = id;
+    confidences[i] = confidence;
+
+    for (int c = 0; c < 4; ++c)
+        setCorner(i, c, points[c]);
+
+    fill(begin(rotations[i]), end(rotations[i]), 0.0f);
+    fill(begin(translations[i]), end(translations[i]), 0.0f);
+    fill(&cubes[i][0][0][0], &cubes[i][0][0][0] + cubeLines * 4, 0.0f);
+
+    return i;
+}
+
+void MarkerResults::move(int from, int to) noexcept
+{
+    if (from == to)
+        return;
+
+    ids[to] = ids[from];
+    confidences[to] = confidences[from];
+    copy(&corners[from][0][0], &corners[from][0][0] + 8, &corners[to][0][0]);
+    copy(begin(rotations[from]), end(rotations[from]), begin(rotations[to]));
+    copy(begin(translations[from]), end(translations[from]), begin(translations[to]));
+    copy(&cubes[from][0][0][0], &cubes[from][0][0][0] + cubeLines * 4, &cubes[to][0][0][0]);
+}
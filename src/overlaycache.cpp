@@ -0,0 +1,180 @@
+// Copyright (c) 2017 Elvis Dukaj
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "overlaycache.h"
+#include <QDir>
+#include <QImage>
+#include <opencv2/imgproc.hpp>
+
+using namespace cv;
+using namespace std;
+
+namespace {
+
+Mat toMat(const QImage& image, int type)
+{
+    return Mat{image.height(), image.width(), type, const_cast<uchar*>(image.constBits()),
+               static_cast<size_t>(image.bytesPerLine())}.clone();
+}
+
+}
+
+OverlayCache::OverlayCache(size_t capacity)
+    : m_capacity{std::max<size_t>(capacity, 1)}
+{
+}
+
+void OverlayCache::setDirectory(const QString& directory)
+{
+    if (m_directory == directory)
+        return;
+
+    m_directory = directory;
+    clear();
+}
+
+void OverlayCache::clear()
+{
+    m_entries.clear();
+    m_index.clear();
+    m_missing.clear();
+}
+
+const OverlayCache::Overlay& OverlayCache::overlay(uint64_t id, int frameType)
+{
+    const Key key{id, frameType};
+    auto found = m_index.find(key);
+
+    if (found != m_index.end())
+    {
+        m_entries.splice(m_entries.begin(), m_entries, found->second);
+        return found->second->overlay;
+    }
+
+    if (m_missing.count(key))
+        return m_none;
+
+    auto loaded = load(id, frameType);
+
+    if (loaded.image.empty())
+    {
+        m_missing.insert(key);
+        return m_none;
+    }
+
+    if (m_entries.size() >= m_capacity)
+    {
+        m_index.erase(m_entries.back().key);
+        m_entries.pop_back();
+    }
+
+    m_entries.push_front(Entry{key, std::move(loaded)});
+    m_index[key] = m_entries.begin();
+
+    return m_entries.front().overlay;
+}
+
+OverlayCache::Overlay OverlayCache::load(uint64_t id, int frameType) const
+{
+    Overlay overlay;
+
+    if (m_directory.isEmpty())
+        return overlay;
+
+    const QDir directory{m_directory};
+    QImage image;
+
+    for (const char* extension : {"png", "jpg"})
+    {
+        image = QImage{directory.filePath(QString{"%1.%2"}.arg(id).arg(QLatin1String{extension}))};
+
+        if (!image.isNull())
+            break;
+    }
+
+    if (image.isNull())
+        return overlay;
+
+    // QImage::Format_ARGB32 has the byte order of QVideoFrame::Format_RGB32
+    const auto argb = image.convertToFormat(QImage::Format_ARGB32);
+
+    switch (frameType) {
+    case CV_8UC4:
+        overlay.image = toMat(argb, CV_8UC4);
+        break;
+
+    case CV_8UC3:
+        overlay.image = toMat(image.convertToFormat(QImage::Format_RGB888), CV_8UC3);
+        break;
+
+    case CV_8UC1:
+        overlay.image = toMat(image.convertToFormat(QImage::Format_Grayscale8), CV_8UC1);
+        break;
+
+    default:
+        return overlay;
+    }
+
+    if (image.hasAlphaChannel())
+    {
+        extractChannel(toMat(argb, CV_8UC4), overlay.mask, 3);
+        threshold(overlay.mask, overlay.mask, 127, 255, THRESH_BINARY);
+    }
+
+    return overlay;
+}
+
+void drawMarkerOverlay(Mat& frame, const MarkerResults& markers, int i, const OverlayCache::Overlay& overlay,
+                       Mat& warpedImage, Mat& warpedMask)
+{
+    if (overlay.image.empty())
+        return;
+
+    const Rect roi = boundingRect(markers.cornersOf(i)) & Rect{Point{0, 0}, frame.size()};
+
+    if (roi.area() == 0)
+        return;
+
+    // The overlay is mapped straight to the bounding box of the marker
+    const auto width = static_cast<float>(overlay.image.cols);
+    const auto height = static_cast<float>(overlay.image.rows);
+    const Point2f source[] = {{0.0f, 0.0f}, {width, 0.0f}, {width, height}, {0.0f, height}};
+    Point2f target[4];
+
+    for (int c = 0; c < 4; ++c)
+        target[c] = markers.corner(i, c) - Point2f{static_cast<float>(roi.x), static_cast<float>(roi.y)};
+
+    const Mat transform = getPerspectiveTransform(source, target);
+    Mat destination = frame(roi);
+
+    // Pixels outside the overlay are left untouched
+    if (overlay.mask.empty())
+    {
+        warpPerspective(overlay.image, destination, transform, roi.size(), INTER_LINEAR, BORDER_TRANSPARENT);
+        return;
+    }
+
+    warpPerspective(overlay.image, warpedImage, transform, roi.size(), INTER_LINEAR, BORDER_CONSTANT);
+    warpPerspective(overlay.mask, warpedMask, transform, roi.size(), INTER_NEAREST, BORDER_CONSTANT, Scalar::all(0));
+    warpedImage.copyTo(destination, warpedMask);
+}
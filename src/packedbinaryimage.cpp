@@ -0,0 +1,157 @@
+// Copyright (c) 2017 Elvis Dukaj
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "packedbinaryimage.h"
+#include <algorithm>
+#include <cfloat>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PACKED_BINARY_IMAGE_SSE2
+#endif
+
+using namespace cv;
+using namespace std;
+
+namespace {
+
+uint64_t packWord(const uchar* pixels, int count, uchar thresholdValue) noexcept
+{
+    uint64_t word = 0;
+
+#if defined(PACKED_BINARY_IMAGE_SSE2)
+    if (count == 64)
+    {
+        // Unsigned comparison through the signed one, both sides biased by 0x80
+        const __m128i bias = _mm_set1_epi8(static_cast<char>(0x80));
+        const __m128i thresholds = _mm_set1_epi8(static_cast<char>(thresholdValue ^ 0x80));
+
+        for (int i = 0; i < 4; ++i)
+        {
+            auto values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + 16 * i));
+            auto greater = _mm_cmpgt_epi8(_mm_xor_si128(values, bias), thresholds);
+            word |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(greater))) << (16 * i);
+        }
+
+        return word;
+    }
+#endif
+
+    for (int i = 0; i < count; ++i)
+        word |= static_cast<uint64_t>(pixels[i] > thresholdValue) << i;
+
+    return word;
+}
+
+}
+
+PackedBinaryImage::PackedBinaryImage()
+    : m_rows{0}
+    , m_cols{0}
+    , m_wordsPerRow{0}
+{
+}
+
+void PackedBinaryImage::threshold(const Mat& grayscale, int thresholdValue)
+{
+    CV_Assert(grayscale.type() == CV_8UC1);
+
+    m_rows = grayscale.rows;
+    m_cols = grayscale.cols;
+    m_wordsPerRow = (m_cols + 63) / 64;
+    m_words.resize(static_cast<size_t>(m_rows) * m_wordsPerRow);
+
+    if (thresholdValue < 0)
+    {
+        // Every pixel passes, as with cv::threshold
+        fill(begin(m_words), end(m_words), ~uint64_t{0});
+
+        if (m_cols % 64)
+            for (int y = 0; y < m_rows; ++y)
+                m_words[static_cast<size_t>(y + 1) * m_wordsPerRow - 1] = ~uint64_t{0} >> (64 - m_cols % 64);
+
+        return;
+    }
+
+    const auto t = static_cast<uchar>(std::min(thresholdValue, 255));
+
+    for (int y = 0; y < m_rows; ++y)
+    {
+        const uchar* pixels = grayscale.ptr<uchar>(y);
+        uint64_t* words = m_words.data() + static_cast<size_t>(y) * m_wordsPerRow;
+
+        for (int w = 0; w < m_wordsPerRow; ++w)
+            words[w] = packWord(pixels + 64 * w, std::min(m_cols - 64 * w, 64), t);
+    }
+}
+
+int otsuThreshold(const Mat& grayscale)
+{
+    CV_Assert(grayscale.type() == CV_8UC1);
+
+    int histogram[256] = {0};
+
+    for (int y = 0; y < grayscale.rows; ++y)
+    {
+        const uchar* pixels = grayscale.ptr<uchar>(y);
+
+        for (int x = 0; x < grayscale.cols; ++x)
+            ++histogram[pixels[x]];
+    }
+
+    const double scale = 1.0 / (static_cast<double>(grayscale.rows) * grayscale.cols);
+    double mu = 0.0;
+
+    for (int i = 0; i < 256; ++i)
+        mu += i * static_cast<double>(histogram[i]);
+
+    mu *= scale;
+
+    double mu1 = 0.0, q1 = 0.0;
+    double maxSigma = 0.0;
+    int maxValue = 0;
+
+    for (int i = 0; i < 256; ++i)
+    {
+        const double p = histogram[i] * scale;
+
+        mu1 *= q1;
+        q1 += p;
+        const double q2 = 1.0 - q1;
+
+        if (std::min(q1, q2) < FLT_EPSILON || std::max(q1, q2) > 1.0 - FLT_EPSILON)
+            continue;
+
+        mu1 = (mu1 + i * p) / q1;
+        const double mu2 = (mu - q1 * mu1) / q2;
+        const double sigma = q1 * q2 * (mu1 - mu2) * (mu1 - mu2);
+
+        if (sigma > maxSigma)
+        {
+            maxSigma = sigma;
+            maxValue = i;
+        }
+    }
+
+    return maxValue;
+}
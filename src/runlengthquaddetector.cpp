@@ -0,0 +1,275 @@
+// Copyright (c) 2017 Elvis Dukaj
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "runlengthquaddetector.h"
+#include "bitops.h"
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+using namespace cv;
+using namespace std;
+
+namespace {
+
+// Components whose area covers less or more of their quad than this
+// are not markers: the black border alone covers 44 of the 144 cells
+// and a marker always has some white cells
+const double minFill = 0.25;
+const double maxFill = 0.95;
+
+// First pixel at or after x whose bit equals value, or cols if none
+int nextPixel(const uint64_t* row, int x, int cols, bool value) noexcept
+{
+    if (x >= cols)
+        return cols;
+
+    const int words = (cols + 63) / 64;
+    int w = x >> 6;
+    uint64_t bits = (value ? row[w] : ~row[w]) & (~uint64_t{0} << (x & 63));
+
+    while (bits == 0)
+    {
+        if (++w == words)
+            return cols;
+
+        bits = value ? row[w] : ~row[w];
+    }
+
+    return std::min(w * 64 + countTrailingZeros(bits), cols);
+}
+
+void keepMin(int value, Point point, int& current, Point& currentPoint) noexcept
+{
+    if (value < current)
+    {
+        current = value;
+        currentPoint = point;
+    }
+}
+
+void keepMax(int value, Point point, int& current, Point& currentPoint) noexcept
+{
+    if (value > current)
+    {
+        current = value;
+        currentPoint = point;
+    }
+}
+
+double quadArea(const vector<Point2f>& quad) noexcept
+{
+    double area = 0.0;
+
+    for (size_t i = 0; i < quad.size(); ++i)
+    {
+        const auto& a = quad[i];
+        const auto& b = quad[(i + 1) % quad.size()];
+        area += static_cast<double>(a.x) * b.y - static_cast<double>(b.x) * a.y;
+    }
+
+    return std::abs(area) / 2.0;
+}
+
+}
+
+void RunLengthQuadDetector::Component::add(const Run& run, int y) noexcept
+{
+    const Point first{run.begin, y};
+    const Point last{run.end - 1, y};
+
+    area += run.end - run.begin;
+    minX = std::min(minX, first.x);
+    maxX = std::max(maxX, last.x);
+    minY = std::min(minY, y);
+    maxY = std::max(maxY, y);
+
+    keepMin(y, first, top.value, top.point);
+    keepMax(y, first, bottom.value, bottom.point);
+    keepMin(first.x, first, left.value, left.point);
+    keepMax(last.x, last, right.value, right.point);
+    keepMin(first.x + y, first, minSum.value, minSum.point);
+    keepMax(last.x + y, last, maxSum.value, maxSum.point);
+    keepMin(first.x - y, first, minDiff.value, minDiff.point);
+    keepMax(last.x - y, last, maxDiff.value, maxDiff.point);
+}
+
+void RunLengthQuadDetector::Component::merge(const Component& other) noexcept
+{
+    area += other.area;
+    minX = std::min(minX, other.minX);
+    maxX = std::max(maxX, other.maxX);
+    minY = std::min(minY, other.minY);
+    maxY = std::max(maxY, other.maxY);
+
+    keepMin(other.top.value, other.top.point, top.value, top.point);
+    keepMax(other.bottom.value, other.bottom.point, bottom.value, bottom.point);
+    keepMin(other.left.value, other.left.point, left.value, left.point);
+    keepMax(other.right.value, other.right.point, right.value, right.point);
+    keepMin(other.minSum.value, other.minSum.point, minSum.value, minSum.point);
+    keepMax(other.maxSum.value, other.maxSum.point, maxSum.value, maxSum.point);
+    keepMin(other.minDiff.value, other.minDiff.point, minDiff.value, minDiff.point);
+    keepMax(other.maxDiff.value, other.maxDiff.point, maxDiff.value, maxDiff.point);
+}
+
+void RunLengthQuadDetector::detect(const PackedBinaryImage& image, Point offset, float minSquaredSideLength,
+                                   vector<vector<Point2f>>& quads)
+{
+    const int cols = image.cols();
+
+    m_components.clear();
+    m_previousRuns.clear();
+
+    for (int y = 0; y < image.rows(); ++y)
+    {
+        const uint64_t* row = image.row(y);
+        size_t previous = 0;
+
+        m_currentRuns.clear();
+
+        // Markers are dark on white: components are made of unset pixels
+        for (int x = nextPixel(row, 0, cols, false); x < cols; )
+        {
+            Run run{x, nextPixel(row, x, cols, true), -1};
+
+            // Runs of the previous row are sorted too, skip those ending
+            // before this one can touch them diagonally
+            while (previous < m_previousRuns.size() && m_previousRuns[previous].end < run.begin)
+                ++previous;
+
+            for (size_t i = previous; i < m_previousRuns.size() && m_previousRuns[i].begin <= run.end; ++i)
+                run.label = run.label < 0 ? find(m_previousRuns[i].label) : unite(run.label, m_previousRuns[i].label);
+
+            if (run.label < 0)
+                run.label = newComponent();
+
+            m_components[run.label].add(run, y);
+            m_currentRuns.push_back(run);
+
+            x = nextPixel(row, run.end, cols, false);
+        }
+
+        swap(m_previousRuns, m_currentRuns);
+    }
+
+    vector<Point2f> quad;
+
+    for (size_t i = 0; i < m_components.size(); ++i)
+    {
+        const auto& component = m_components[i];
+
+        if (component.parent != static_cast<int>(i) || !fitQuad(component, minSquaredSideLength, quad))
+            continue;
+
+        for (auto& corner : quad)
+            corner += Point2f{static_cast<float>(offset.x), static_cast<float>(offset.y)};
+
+        quads.push_back(quad);
+    }
+}
+
+int RunLengthQuadDetector::newComponent()
+{
+    Component component;
+    component.parent = static_cast<int>(m_components.size());
+    component.area = 0;
+    component.minX = component.minY = INT_MAX;
+    component.maxX = component.maxY = INT_MIN;
+    component.top.value = component.left.value = component.minSum.value = component.minDiff.value = INT_MAX;
+    component.bottom.value = component.right.value = component.maxSum.value = component.maxDiff.value = INT_MIN;
+
+    m_components.push_back(component);
+    return component.parent;
+}
+
+int RunLengthQuadDetector::find(int label) noexcept
+{
+    while (m_components[label].parent != label)
+    {
+        m_components[label].parent = m_components[m_components[label].parent].parent;
+        label = m_components[label].parent;
+    }
+
+    return label;
+}
+
+int RunLengthQuadDetector::unite(int a, int b) noexcept
+{
+    a = find(a);
+    b = find(b);
+
+    if (a == b)
+        return a;
+
+    if (b < a)
+        swap(a, b);
+
+    m_components[a].merge(m_components[b]);
+    m_components[b].parent = a;
+
+    return a;
+}
+
+bool RunLengthQuadDetector::fitQuad(const Component& component, float minSquaredSideLength, vector<Point2f>& quad) const
+{
+    const float width = static_cast<float>(component.maxX - component.minX + 1);
+    const float height = static_cast<float>(component.maxY - component.minY + 1);
+
+    if (width * width < minSquaredSideLength || height * height < minSquaredSideLength)
+        return false;
+
+    const auto toPoint2f = [](const Extreme& e) {
+        return Point2f{static_cast<float>(e.point.x), static_cast<float>(e.point.y)};
+    };
+
+    // The corners maximize the area of the inscribed quad, whatever the rotation
+    vector<Point2f> diagonal{toPoint2f(component.top), toPoint2f(component.right),
+                             toPoint2f(component.bottom), toPoint2f(component.left)};
+    vector<Point2f> upright{toPoint2f(component.minSum), toPoint2f(component.maxDiff),
+                            toPoint2f(component.maxSum), toPoint2f(component.minDiff)};
+
+    const auto diagonalArea = quadArea(diagonal);
+    const auto uprightArea = quadArea(upright);
+
+    quad = diagonalArea > uprightArea ? diagonal : upright;
+    const auto area = std::max(diagonalArea, uprightArea);
+
+    if (area <= 0.0)
+        return false;
+
+    const auto fill = static_cast<double>(component.area) / area;
+
+    if (fill < minFill || fill > maxFill)
+        return false;
+
+    for (int i = 0; i < 4; i++)
+    {
+        auto side = quad[i] - quad[(i + 1) % 4];
+
+        if (side.dot(side) < minSquaredSideLength)
+            return false;
+    }
+
+    return isContourConvex(quad);
+}
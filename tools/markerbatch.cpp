@@ -0,0 +1,107 @@
+// Copyright (c) 2017 Elvis Dukaj
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "batchdetector.h"
+#include "framerecording.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+static void usage()
+{
+    cerr << "usage: markerbatch <recording> <results> [--threads <count>] [--chunk <frames>] [--backend <name>]" << endl
+         << "  --threads 0 uses one thread per core (default)" << endl
+         << "  --chunk is the number of consecutive frames tracked together, 32 by default" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    int threads = 0;
+    size_t chunk = 32;
+    string backend = DetectorBackend::available().front();
+
+    for (int i = 3; i < argc; ++i)
+    {
+        const string arg = argv[i];
+
+        if (arg == "--threads" && i + 1 < argc)
+            threads = stoi(argv[++i]);
+        else if (arg == "--chunk" && i + 1 < argc)
+            chunk = static_cast<size_t>(stoul(argv[++i]));
+        else if (arg == "--backend" && i + 1 < argc)
+            backend = argv[++i];
+        else
+        {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    try
+    {
+        FrameReplay replay{QString::fromLocal8Bit(argv[1])};
+        ResultRecorder recorder{QString::fromLocal8Bit(argv[2])};
+
+        auto detector = make_shared<MarksDetector>();
+        detector->setBackend(backend);
+
+        BatchDetector batch{detector};
+        batch.setThreads(threads);
+        batch.setChunkSize(chunk);
+
+        uint64_t markers = 0;
+        const auto start = chrono::steady_clock::now();
+
+        batch.run(replay.size(),
+                  [&](size_t i) { return replay.frame(i); },
+                  [&](size_t i, const MarkerResults& found)
+                  {
+                      recorder.record(static_cast<uint32_t>(i), replay.timestamp(i), found);
+                      markers += found.size();
+                  });
+
+        recorder.finish();
+
+        const chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+        cout << recorder.frameCount() << " frames in " << elapsed.count() << " s ("
+             << recorder.frameCount() / elapsed.count() << " fps), "
+             << markers << " markers found" << endl;
+    }
+    catch(const exception& exc)
+    {
+        cerr << exc.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,217 @@
+// Copyright (c) 2017 Elvis Dukaj
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "framerecording.h"
+#include "markerdetector.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Compares the detector back-ends on a recording. There is no ground truth:
+// the reference markers of a frame are those found by any of the back-ends,
+// and the recall of a back-end is the fraction of them it found.
+
+namespace {
+
+struct BackendRun {
+    string name;
+    uint64_t frames = 0;
+    double seconds = 0.0;
+    chrono::microseconds p50{0};
+    chrono::microseconds p99{0};
+    chrono::microseconds max{0};
+    // Sorted ids found in each frame of the first loop
+    vector<vector<uint64_t>> ids;
+};
+
+void usage()
+{
+    cerr << "usage: markerbenchmark <recording> [--backends <name>,<name>...] [--loop <count>]" << endl
+         << "  --backends defaults to all of";
+
+    for (const auto& name : DetectorBackend::available())
+        cerr << " " << name;
+
+    cerr << endl;
+}
+
+vector<string> split(const string& list)
+{
+    vector<string> names;
+    stringstream stream{list};
+
+    for (string name; getline(stream, name, ','); )
+        if (!name.empty())
+            names.push_back(name);
+
+    return names;
+}
+
+BackendRun run(const FrameReplay& replay, const string& backend, int loops)
+{
+    BackendRun result;
+    LatencyHistogram latencies;
+    MarksDetector detector;
+    detector.setBackend(backend);
+
+    result.name = backend;
+    result.ids.resize(replay.size());
+
+    const auto start = chrono::steady_clock::now();
+
+    for (int loop = 0; loop < loops; ++loop)
+    {
+        for (size_t i = 0; i < replay.size(); ++i)
+        {
+            auto frame = replay.frame(i);
+
+            const auto frameStart = chrono::steady_clock::now();
+            detector.processFame(frame);
+            latencies.record(chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - frameStart));
+
+            ++result.frames;
+
+            if (loop > 0)
+                continue;
+
+            const auto& markers = detector.markers();
+            auto& ids = result.ids[i];
+
+            ids.assign(markers.ids, markers.ids + markers.size());
+            sort(begin(ids), end(ids));
+            ids.erase(unique(begin(ids), end(ids)), end(ids));
+        }
+    }
+
+    const chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    result.seconds = elapsed.count();
+    result.p50 = latencies.percentile(0.5);
+    result.p99 = latencies.percentile(0.99);
+    result.max = latencies.max();
+
+    return result;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    vector<string> backends = DetectorBackend::available();
+    int loops = 1;
+
+    for (int i = 2; i < argc; ++i)
+    {
+        const string arg = argv[i];
+
+        if (arg == "--backends" && i + 1 < argc)
+            backends = split(argv[++i]);
+        else if (arg == "--loop" && i + 1 < argc)
+            loops = std::max(stoi(argv[++i]), 1);
+        else
+        {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    try
+    {
+        FrameReplay replay{QString::fromLocal8Bit(argv[1])};
+
+        if (replay.size() == 0)
+        {
+            cerr << "No frames in " << argv[1] << endl;
+            return EXIT_FAILURE;
+        }
+
+        vector<BackendRun> runs;
+
+        for (const auto& backend : backends)
+            runs.push_back(run(replay, backend, loops));
+
+        // Markers found by each back-end among those found by any
+        vector<uint64_t> found(runs.size(), 0);
+        uint64_t reference = 0;
+        vector<uint64_t> frameReference;
+
+        for (size_t i = 0; i < replay.size(); ++i)
+        {
+            frameReference.clear();
+
+            for (const auto& r : runs)
+                frameReference.insert(end(frameReference), begin(r.ids[i]), end(r.ids[i]));
+
+            sort(begin(frameReference), end(frameReference));
+            frameReference.erase(unique(begin(frameReference), end(frameReference)), end(frameReference));
+
+            reference += frameReference.size();
+
+            for (size_t b = 0; b < runs.size(); ++b)
+                found[b] += runs[b].ids[i].size();
+        }
+
+        cout << replay.size() << " frames, " << loops << " loop(s), "
+             << reference << " reference markers" << endl;
+
+        cout << left << setw(12) << "backend" << right
+             << setw(10) << "fps" << setw(10) << "p50 ms" << setw(10) << "p99 ms"
+             << setw(10) << "max ms" << setw(10) << "markers" << setw(10) << "recall" << endl;
+
+        cout << fixed;
+
+        for (size_t b = 0; b < runs.size(); ++b)
+        {
+            const auto& r = runs[b];
+            const auto ms = [](chrono::microseconds value) { return value.count() / 1000.0; };
+
+            cout << left << setw(12) << r.name << right << setprecision(1)
+                 << setw(10) << r.frames / r.seconds
+                 << setprecision(2)
+                 << setw(10) << ms(r.p50) << setw(10) << ms(r.p99) << setw(10) << ms(r.max)
+                 << setw(10) << found[b]
+                 << setprecision(3)
+                 << setw(10) << (reference ? static_cast<double>(found[b]) / reference : 1.0) << endl;
+        }
+    }
+    catch(const exception& exc)
+    {
+        cerr << exc.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,164 @@
+// Copyright (c) 2017 Elvis Dukaj
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "framerecording.h"
+#include "markerdetector.h"
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+
+using namespace std;
+
+static void usage()
+{
+    cerr << "usage: markerreplay <recording> [--speed <factor>] [--loop <count>] [--verbose] [--stats] [--trace <file>]" << endl
+         << "                    [--backend <name>] [--changes]" << endl
+         << "  --speed 0 replays as fast as possible, 1 in real time (default)" << endl
+         << "  --backend picks the candidate search, one of";
+
+    for (const auto& name : DetectorBackend::available())
+        cerr << " " << name;
+
+    cerr << endl
+         << "  --changes searches only the parts of the frames that changed" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    double speed = 1.0;
+    int loops = 1;
+    bool verbose = false;
+    bool stats = false;
+    string traceFile;
+    string backend = DetectorBackend::available().front();
+    bool changes = false;
+
+    for (int i = 2; i < argc; ++i)
+    {
+        const string arg = argv[i];
+
+        if (arg == "--speed" && i + 1 < argc)
+            speed = stod(argv[++i]);
+        else if (arg == "--loop" && i + 1 < argc)
+            loops = stoi(argv[++i]);
+        else if (arg == "--verbose")
+            verbose = true;
+        else if (arg == "--stats")
+            stats = true;
+        else if (arg == "--trace" && i + 1 < argc)
+            traceFile = argv[++i];
+        else if (arg == "--changes")
+            changes = true;
+        else if (arg == "--backend" && i + 1 < argc)
+            backend = argv[++i];
+        else
+        {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    try
+    {
+        FrameReplay replay{QString::fromLocal8Bit(argv[1])};
+        MarksDetector detector;
+        detector.setBackend(backend);
+        detector.setChangeDetection(changes);
+
+        if (replay.size() == 0)
+        {
+            cerr << "No frames in " << argv[1] << endl;
+            return EXIT_FAILURE;
+        }
+
+        if (!traceFile.empty())
+            FrameTracer::instance().start();
+
+        uint64_t frames = 0;
+        uint64_t markers = 0;
+        const auto start = chrono::steady_clock::now();
+
+        for (int loop = 0; loop < loops; ++loop)
+        {
+            const auto loopStart = chrono::steady_clock::now();
+
+            for (size_t i = 0; i < replay.size(); ++i)
+            {
+                if (speed > 0.0)
+                {
+                    auto offset = chrono::microseconds{
+                        static_cast<int64_t>((replay.timestamp(i) - replay.timestamp(0)) / speed)};
+                    this_thread::sleep_until(loopStart + offset);
+                }
+
+                auto frame = replay.frame(i);
+                detector.processFame(frame);
+
+                ++frames;
+                markers += detector.markers().size();
+
+                if (verbose)
+                {
+                    cout << i << ":";
+                    const auto& found = detector.markers();
+                    for (int m = 0; m < found.size(); ++m)
+                        cout << " " << found.ids[m];
+                    cout << endl;
+                }
+            }
+        }
+
+        const chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+        cout << frames << " frames in " << elapsed.count() << " s ("
+             << frames / elapsed.count() << " fps), "
+             << markers << " markers found" << endl;
+
+        if (stats)
+            detector.stats().dump(cout);
+
+        if (!traceFile.empty())
+        {
+            FrameTracer::instance().stop();
+
+            ofstream trace{traceFile};
+            FrameTracer::instance().exportJson(trace);
+        }
+    }
+    catch(const exception& exc)
+    {
+        cerr << exc.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
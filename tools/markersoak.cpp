@@ -0,0 +1,443 @@
+// Copyright (c) 2017 Elvis Dukaj
+// 
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+// 
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "markerdetector.h"
+#include "markerdetectorfilter.h"
+#include <QCoreApplication>
+#include <QImage>
+#include <QVideoFrame>
+#include <QVideoSurfaceFormat>
+#include <opencv2/imgproc.hpp>
+#include <malloc.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+using namespace cv;
+using namespace std;
+
+// Soak test of the detection path: synthetic frames holding encoded markers
+// are detected over and over, while every heap allocation, operator new and
+// cv::Mat buffers alike, is counted. After the warm-up each window of frames
+// must allocate as often per frame as the first one, and neither the live
+// heap nor the resident set may keep growing.
+
+namespace {
+
+atomic<uint64_t> heapAllocations{0};
+atomic<int64_t> heapBytes{0};
+
+// Counts the cv::Mat buffers, which do not go through operator new
+class CountingMatAllocator : public MatAllocator {
+public:
+    UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                       int flags, UMatUsageFlags usageFlags) const override
+    {
+        UMatData* u = Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usageFlags);
+
+        if (u)
+        {
+            // Released through this allocator too
+            u->currAllocator = this;
+
+            if (!(u->flags & UMatData::USER_ALLOCATED))
+            {
+                m_allocations.fetch_add(1, memory_order_relaxed);
+                m_bytes.fetch_add(static_cast<int64_t>(u->size), memory_order_relaxed);
+            }
+        }
+
+        return u;
+    }
+
+    bool allocate(UMatData* u, int accessFlags, UMatUsageFlags usageFlags) const override
+    {
+        return Mat::getStdAllocator()->allocate(u, accessFlags, usageFlags);
+    }
+
+    void deallocate(UMatData* u) const override
+    {
+        if (!u)
+            return;
+
+        if (!(u->flags & UMatData::USER_ALLOCATED))
+            m_bytes.fetch_sub(static_cast<int64_t>(u->size), memory_order_relaxed);
+
+        Mat::getStdAllocator()->deallocate(u);
+    }
+
+    uint64_t allocations() const noexcept { return m_allocations; }
+    int64_t bytes() const noexcept { return m_bytes; }
+
+private:
+    mutable atomic<uint64_t> m_allocations{0};
+    mutable atomic<int64_t> m_bytes{0};
+};
+
+CountingMatAllocator matAllocator;
+
+struct MemorySample {
+    uint64_t allocations;
+    int64_t liveBytes;
+    int64_t residentBytes;
+    int64_t peakResidentBytes;
+};
+
+MemorySample sampleMemory()
+{
+    MemorySample sample;
+    sample.allocations = heapAllocations + matAllocator.allocations();
+    sample.liveBytes = heapBytes + matAllocator.bytes();
+    sample.residentBytes = 0;
+
+    // Second field of statm: resident pages
+    if (FILE* statm = fopen("/proc/self/statm", "r"))
+    {
+        long size = 0, resident = 0;
+
+        if (fscanf(statm, "%ld %ld", &size, &resident) == 2)
+            sample.residentBytes = static_cast<int64_t>(resident) * sysconf(_SC_PAGESIZE);
+
+        fclose(statm);
+    }
+
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    sample.peakResidentBytes = static_cast<int64_t>(usage.ru_maxrss) * 1024;
+
+    return sample;
+}
+
+// Grayscale frames with a few markers each, at different places, sizes and
+// angles so that the candidate search, tracking and change detection all
+// have work to do
+vector<Mat> makeFrames(Size size, int count)
+{
+    using Layout = DefaultMarkerLayout;
+
+    vector<Mat> frames;
+    RNG rng{0x50a4};
+
+    for (int f = 0; f < count; ++f)
+    {
+        Mat frame{size, CV_8UC1, Scalar{190}};
+
+        const int markers = 1 + f % 3;
+
+        for (int m = 0; m < markers; ++m)
+        {
+            const uint64_t high = rng.next();
+            const uint64_t low = rng.next() & 0xffff;
+            const auto cells = MarkerCodec<Layout>::encode(high << 16 | low);
+
+            // White quiet zone of one cell around the marker
+            const int quiet = Layout::cellPixels;
+            Mat marker{Layout::imageSize + 2 * quiet, Layout::imageSize + 2 * quiet, CV_8UC1, Scalar{255}};
+
+            for (int i = 0; i < Layout::gridSize; ++i)
+                for (int j = 0; j < Layout::gridSize; ++j)
+                    if (!((cells[i] >> j) & 1))
+                        marker(Rect{quiet + j * Layout::cellPixels, quiet + i * Layout::cellPixels,
+                                    Layout::cellPixels, Layout::cellPixels}).setTo(Scalar{20});
+
+            const float side = static_cast<float>(rng.uniform(size.height / 8, size.height / 4));
+            const float angle = static_cast<float>(rng.uniform(0.0, CV_PI / 2));
+            const Point2f center{(m + 0.5f) * size.width / markers, size.height / 2.0f + rng.uniform(-0.2f, 0.2f) * size.height};
+
+            vector<Point2f> source = {
+                {0.0f, 0.0f}, {static_cast<float>(marker.cols), 0.0f},
+                {static_cast<float>(marker.cols), static_cast<float>(marker.rows)}, {0.0f, static_cast<float>(marker.rows)}
+            };
+            vector<Point2f> target;
+
+            for (int c = 0; c < 4; ++c)
+            {
+                const float a = angle + static_cast<float>(CV_PI / 2) * c - static_cast<float>(3 * CV_PI / 4);
+                // A slight perspective, corners are not all at the same distance
+                const float r = side / sqrt(2.0f) * (1.0f + 0.05f * ((c + m) % 2));
+                target.emplace_back(center.x + r * cos(a), center.y + r * sin(a));
+            }
+
+            warpPerspective(marker, frame, getPerspectiveTransform(source, target), size,
+                            INTER_LINEAR, BORDER_TRANSPARENT);
+        }
+
+        frames.push_back(frame);
+    }
+
+    return frames;
+}
+
+void usage()
+{
+    cerr << "usage: markersoak [--frames <count>] [--warmup <frames>] [--window <frames>] [--size <width>x<height>]" << endl
+         << "                  [--filter] [--backend <name>] [--changes]" << endl
+         << "                  [--allocation-tolerance <percent>] [--heap-tolerance <KB>] [--rss-tolerance <KB>]" << endl
+         << "  --filter runs the frames through MarkerDetectorFilter as RGB32 video frames" << endl
+         << "  defaults: 1000000 frames, 2000 warm-up, windows of 10000, 640x480, tolerances 1%, 256 KB, 4096 KB" << endl;
+}
+
+// Blocks are plain malloc blocks accounted with their usable size, so that
+// memory malloc'ed by the standard library and released through operator
+// delete stays valid. The array forms end up in the ones below.
+void* countedAllocate(size_t size) noexcept
+{
+    void* block = malloc(size ? size : 1);
+
+    if (block)
+    {
+        heapAllocations.fetch_add(1, memory_order_relaxed);
+        heapBytes.fetch_add(static_cast<int64_t>(malloc_usable_size(block)), memory_order_relaxed);
+    }
+
+    return block;
+}
+
+void countedRelease(void* block) noexcept
+{
+    if (!block)
+        return;
+
+    heapBytes.fetch_sub(static_cast<int64_t>(malloc_usable_size(block)), memory_order_relaxed);
+    free(block);
+}
+
+}
+
+void* operator new(size_t size)
+{
+    void* block = countedAllocate(size);
+
+    if (!block)
+        throw bad_alloc{};
+
+    return block;
+}
+
+void* operator new(size_t size, const nothrow_t&) noexcept
+{
+    return countedAllocate(size);
+}
+
+void operator delete(void* pointer) noexcept
+{
+    countedRelease(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+    countedRelease(pointer);
+}
+
+void operator delete(void* pointer, const nothrow_t&) noexcept
+{
+    countedRelease(pointer);
+}
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication app{argc, argv};
+
+    uint64_t frameCount = 1000000;
+    uint64_t warmup = 2000;
+    uint64_t window = 10000;
+    Size size{640, 480};
+    bool throughFilter = false;
+    string backend = DetectorBackend::available().front();
+    bool changes = false;
+    double allocationTolerance = 1.0;
+    int64_t heapTolerance = 256 * 1024;
+    int64_t residentTolerance = 4096 * 1024;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const string arg = argv[i];
+
+        if (arg == "--frames" && i + 1 < argc)
+            frameCount = stoull(argv[++i]);
+        else if (arg == "--warmup" && i + 1 < argc)
+            warmup = std::max<uint64_t>(stoull(argv[++i]), 1);
+        else if (arg == "--window" && i + 1 < argc)
+            window = std::max<uint64_t>(stoull(argv[++i]), 1);
+        else if (arg == "--size" && i + 1 < argc && sscanf(argv[++i], "%dx%d", &size.width, &size.height) == 2)
+            continue;
+        else if (arg == "--filter")
+            throughFilter = true;
+        else if (arg == "--backend" && i + 1 < argc)
+            backend = argv[++i];
+        else if (arg == "--changes")
+            changes = true;
+        else if (arg == "--allocation-tolerance" && i + 1 < argc)
+            allocationTolerance = stod(argv[++i]);
+        else if (arg == "--heap-tolerance" && i + 1 < argc)
+            heapTolerance = stoll(argv[++i]) * 1024;
+        else if (arg == "--rss-tolerance" && i + 1 < argc)
+            residentTolerance = stoll(argv[++i]) * 1024;
+        else
+        {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    Mat::setDefaultAllocator(&matAllocator);
+
+    try
+    {
+        // Windows cover the frame pool a whole number of times, so that
+        // each one does exactly the same work
+        const int poolSize = 12;
+        window = (window + poolSize - 1) / poolSize * poolSize;
+
+        const auto frames = makeFrames(size, poolSize);
+
+        vector<QImage> images;
+
+        for (const auto& frame : frames)
+        {
+            Mat color;
+            cvtColor(frame, color, COLOR_GRAY2BGRA);
+            images.push_back(QImage{color.data, color.cols, color.rows, static_cast<int>(color.step), QImage::Format_RGB32}.copy());
+        }
+
+        MarksDetector detector;
+        detector.setBackend(backend);
+        detector.setChangeDetection(changes);
+
+        MarkerDetectorFilter filter;
+        filter.setBackend(QString::fromStdString(backend));
+        filter.setChangeDetection(changes);
+
+        uint64_t markers = 0;
+        unique_ptr<QVideoFilterRunnable> runnable;
+
+        if (throughFilter)
+        {
+            runnable.reset(filter.createFilterRunnable());
+
+            // Emitted from run() on this thread, with the ids of the frame
+            QObject::connect(&filter, &MarkerDetectorFilter::markerFound,
+                             [&markers](const QString& ids)
+                             {
+                                 markers += static_cast<uint64_t>(ids.split(QLatin1Char{' '}, QString::SkipEmptyParts).size());
+                             });
+        }
+
+        const QVideoSurfaceFormat format{QSize{size.width, size.height}, QVideoFrame::Format_RGB32};
+
+        uint64_t markersAtWarmup = 0;
+        bool failed = false;
+        MemorySample baseline{};
+        MemorySample previous{};
+        double baselineRate = 0.0;
+
+        cout << fixed << setprecision(1);
+
+        for (uint64_t n = 0; n < frameCount && !failed; ++n)
+        {
+            const size_t index = n % poolSize;
+
+            if (throughFilter)
+            {
+                // A new frame over the pristine image: mapping it for writing
+                // copies the pixels, like a camera delivering a fresh buffer
+                QVideoFrame frame{images[index]};
+                runnable->run(&frame, format, QVideoFilterRunnable::RunFlags{});
+            }
+            else
+            {
+                Mat frame = frames[index];
+                detector.processFame(frame);
+                markers += detector.markers().size();
+            }
+
+            const uint64_t done = n + 1;
+
+            if (done == warmup)
+            {
+                previous = baseline = sampleMemory();
+                markersAtWarmup = markers;
+            }
+
+            if (done <= warmup || (done - warmup) % window != 0)
+                continue;
+
+            const auto sample = sampleMemory();
+            const double rate = static_cast<double>(sample.allocations - previous.allocations) / window;
+
+            if (done - warmup == window)
+                baselineRate = rate;
+
+            cout << "frame " << done << ": " << rate << " allocations/frame, live heap "
+                 << sample.liveBytes / 1024 << " KB, rss " << sample.residentBytes / (1024.0 * 1024.0)
+                 << " MB (peak " << sample.peakResidentBytes / (1024.0 * 1024.0) << " MB)" << endl;
+
+            if (rate > baselineRate * (1.0 + allocationTolerance / 100.0) + 0.5)
+            {
+                cerr << "Allocations per frame grew from " << baselineRate << " to " << rate << endl;
+                failed = true;
+            }
+
+            if (sample.liveBytes - baseline.liveBytes > heapTolerance)
+            {
+                cerr << "Live heap grew by " << (sample.liveBytes - baseline.liveBytes) / 1024 << " KB since the warm-up" << endl;
+                failed = true;
+            }
+
+            if (baseline.residentBytes > 0 && sample.residentBytes - baseline.residentBytes > residentTolerance)
+            {
+                cerr << "Resident set grew by " << (sample.residentBytes - baseline.residentBytes) / 1024 << " KB since the warm-up" << endl;
+                failed = true;
+            }
+
+            previous = sample;
+        }
+
+        cout << markers << " markers found" << endl;
+
+        // Frames without markers would only soak the binarization
+        if (frameCount > warmup && markers == markersAtWarmup)
+        {
+            cerr << "No marker found after the warm-up" << endl;
+            failed = true;
+        }
+
+        if (failed)
+            return EXIT_FAILURE;
+    }
+    catch(const exception& exc)
+    {
+        cerr << exc.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}